@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "compressor_funcs.h"
+#include "image_transforms.h"
+#include "images.h"
+#include "synthetic_images.h"
+
+/*
+ * Microbenchmarks of the public image functions on deterministic synthetic images.
+ *
+ * Usage: bench_image_compressor [--filter=SUBSTRING] [--max-size=PIXELS] [--min-time=SECONDS]
+ *                               [--out=FILE]
+ *
+ * Results are written as JSON (to stdout unless --out is given); progress goes to stderr.
+ */
+
+struct ImageSize {
+    std::string name;
+    uint32_t width;
+    uint32_t height;
+};
+
+struct BenchmarkCase {
+    std::string name;
+    uint64_t pixels;
+    // Runs one iteration and returns the time spent in the measured part, in nanoseconds.
+    std::function<double()> run;
+};
+
+struct BenchmarkResult {
+    std::string name;
+    uint64_t iterations;
+    double mean_ns;
+    double median_ns;
+    double min_ns;
+    double megapixels_per_second;
+};
+
+struct BenchmarkOptions {
+    std::string filter;
+    uint32_t max_size = 8192;
+    double min_time = 0.2;
+    std::string output;
+};
+
+template <typename Fn>
+static double timed(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+// 216-color images, so every size also fits into a CMPRIMAGE palette.
+static UncompressedImage makeSyntheticImage(uint32_t width, uint32_t height) {
+    SyntheticImageOptions options;
+    options.width = width;
+    options.height = height;
+    options.color_count = 216;
+    options.noise = 0.05;
+    options.flat_fraction = 0.2;
+    return SyntheticImageGenerator(options).generate();
+}
+
+static std::map<uint8_t, ColorRGB> makeSmallPalette() {
+    std::map<uint8_t, ColorRGB> palette;
+    uint8_t id = 0;
+    for (uint8_t r : {0, 255}) {
+        for (uint8_t g : {0, 102, 204}) {
+            for (uint8_t b : {0, 153, 255}) {
+                palette[id++] = ColorRGB{r, g, b};
+            }
+        }
+    }
+    return palette;
+}
+
+static std::vector<std::vector<int>> makeBoxKernel(int size) {
+    return std::vector<std::vector<int>>(size, std::vector<int>(size, 1));
+}
+
+static std::vector<BenchmarkCase> makeCases(
+    const ImageSize& size, const UncompressedImage& source, const CompressedImage& compressed,
+    const std::filesystem::path& tmp_dir) {
+    uint64_t pixels = static_cast<uint64_t>(size.width) * size.height;
+    std::string suffix = "/" + size.name;
+    std::string bmp_file = (tmp_dir / ("bench_" + size.name + ".bmp")).string();
+    std::string raw_file = (tmp_dir / ("bench_" + size.name + ".img")).string();
+    std::string cmpr_file = (tmp_dir / ("bench_" + size.name + ".cmpr")).string();
+    saveAsBMP(source, bmp_file);
+    writeUncompressedFile(raw_file, source);
+    writeCompressedFile(cmpr_file, compressed);
+
+    std::vector<BenchmarkCase> cases;
+    auto add = [&](const std::string& name, std::function<double()> run) {
+        cases.push_back({name + suffix, pixels, std::move(run)});
+    };
+    auto transform = [&](const std::string& name, std::function<void(UncompressedImage&)> fn) {
+        add(name, [&source, fn] {
+            UncompressedImage img = source;
+            return timed([&] { fn(img); });
+        });
+    };
+
+    add("BMP/read", [bmp_file] { return timed([&] { loadFromBMP(bmp_file); }); });
+    add("BMP/write", [&source, bmp_file] { return timed([&] { saveAsBMP(source, bmp_file); }); });
+    add("RAWIMAGE/read", [raw_file] { return timed([&] { readUncompressedFile(raw_file); }); });
+    add("RAWIMAGE/write", [&source, raw_file] {
+        return timed([&] { writeUncompressedFile(raw_file, source); });
+    });
+    add("CMPRIMAGE/read", [cmpr_file] { return timed([&] { readCompressedFile(cmpr_file); }); });
+    add("CMPRIMAGE/write", [&compressed, cmpr_file] {
+        return timed([&] { writeCompressedFile(cmpr_file, compressed); });
+    });
+
+    for (int kernel_size : {3, 5, 7}) {
+        std::string name = std::to_string(kernel_size) + "x" + std::to_string(kernel_size);
+        transform("applyKernel/" + name, [kernel_size](UncompressedImage& img) {
+            applyKernel(img, makeBoxKernel(kernel_size), kernel_size * kernel_size);
+        });
+    }
+
+    // Right angles only: UncompressedImage has no arbitrary-angle rotation, and gap
+    // interpolation does not apply to right angles. The arbitrary case runs on the index plane.
+    for (int angle : {90, 180, 270}) {
+        transform("rotate/" + std::to_string(angle), [angle](UncompressedImage& img) {
+            rotate(img, angle);
+        });
+    }
+    add("rotate/45/compressed", [&compressed] {
+        CompressedImage img = compressed;
+        return timed([&] { rotate(img, 45); });
+    });
+
+    transform("mirror/horizontal", [](UncompressedImage& img) { mirror(img, true); });
+    transform("mirror/vertical", [](UncompressedImage& img) { mirror(img, false); });
+
+    add("toCompressed/exact", [&source] { return timed([&] { toCompressed(source); }); });
+    add("toCompressed/approximate", [&source] {
+        std::map<uint8_t, ColorRGB> palette = makeSmallPalette();
+        return timed([&] { toCompressed(source, palette, true, false); });
+    });
+    add("toUncompressed", [&compressed] { return timed([&] { toUncompressed(compressed); }); });
+    return cases;
+}
+
+static BenchmarkResult runCase(const BenchmarkCase& benchmark, double min_time) {
+    std::vector<double> samples;
+    double total_ns = 0;
+    // At least one iteration; huge images stop after it, small ones repeat until min_time.
+    while (samples.empty() || (total_ns < min_time * 1e9 && samples.size() < 1000000)) {
+        double elapsed = benchmark.run();
+        samples.push_back(elapsed);
+        total_ns += elapsed;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    BenchmarkResult result;
+    result.name = benchmark.name;
+    result.iterations = samples.size();
+    result.mean_ns = total_ns / samples.size();
+    result.median_ns = samples[samples.size() / 2];
+    result.min_ns = samples.front();
+    result.megapixels_per_second = benchmark.pixels / result.mean_ns * 1e3;
+    return result;
+}
+
+static void writeJSON(std::ostream& out, const std::vector<BenchmarkResult>& results) {
+    out << "{\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << result.name
+            << "\", \"iterations\": " << result.iterations << ", \"mean_ns\": " << result.mean_ns
+            << ", \"median_ns\": " << result.median_ns << ", \"min_ns\": " << result.min_ns
+            << ", \"megapixels_per_second\": " << result.megapixels_per_second << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+static bool parseOptions(int argc, char** argv, BenchmarkOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](const std::string& prefix) { return arg.substr(prefix.size()); };
+        if (arg.rfind("--filter=", 0) == 0) {
+            options.filter = value("--filter=");
+        } else if (arg.rfind("--max-size=", 0) == 0) {
+            options.max_size = std::stoul(value("--max-size="));
+        } else if (arg.rfind("--min-time=", 0) == 0) {
+            options.min_time = std::stod(value("--min-time="));
+        } else if (arg.rfind("--out=", 0) == 0) {
+            options.output = value("--out=");
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchmarkOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 2;
+    }
+
+    const std::vector<ImageSize> sizes = {
+        {"64x64", 64, 64},       {"256x256", 256, 256},    {"1024x1024", 1024, 1024},
+        {"4096x4096", 4096, 4096}, {"7680x4320", 7680, 4320}};
+    std::filesystem::path tmp_dir = std::filesystem::temp_directory_path();
+
+    std::vector<BenchmarkResult> results;
+    for (const ImageSize& size : sizes) {
+        if (std::max(size.width, size.height) > options.max_size) {
+            continue;
+        }
+        UncompressedImage source = makeSyntheticImage(size.width, size.height);
+        CompressedImage compressed = toCompressed(source);
+        for (const BenchmarkCase& benchmark : makeCases(size, source, compressed, tmp_dir)) {
+            if (benchmark.name.find(options.filter) == std::string::npos) {
+                continue;
+            }
+            results.push_back(runCase(benchmark, options.min_time));
+            const BenchmarkResult& result = results.back();
+            std::fprintf(stderr, "%-40s %10llu it %14.0f ns %10.2f MP/s\n", result.name.c_str(),
+                         static_cast<unsigned long long>(result.iterations), result.mean_ns,
+                         result.megapixels_per_second);
+        }
+    }
+
+    if (options.output.empty()) {
+        writeJSON(std::cout, results);
+    } else {
+        std::ofstream out(options.output);
+        if (!out.is_open()) {
+            std::cerr << "Cannot open output file " << options.output << std::endl;
+            return 1;
+        }
+        writeJSON(out, results);
+    }
+    return 0;
+}
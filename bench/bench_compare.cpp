@@ -0,0 +1,131 @@
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+/*
+ * Compares a benchmark run with a stored baseline, both in the JSON format written by
+ * bench_image_compressor, and fails when a case got slower than the tolerance allows or when a
+ * baseline case is missing from the current run. An empty baseline is bad input: record one with
+ * `make bench-baseline` on the reference machine.
+ *
+ * Usage: bench_compare BASELINE.json CURRENT.json [--tolerance=0.10]
+ *
+ * Exit codes: 0 - no regressions, 1 - at least one regression or missing case, 2 - bad input.
+ */
+
+static bool readFile(const std::string& filename, std::string& content) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    content = buffer.str();
+    return true;
+}
+
+static bool readNumberField(
+    const std::string& json, size_t begin, size_t end, const std::string& field, double& value) {
+    size_t key = json.find("\"" + field + "\"", begin);
+    if (key == std::string::npos || key > end) {
+        return false;
+    }
+    size_t colon = json.find(':', key);
+    value = std::strtod(json.c_str() + colon + 1, nullptr);
+    return true;
+}
+
+// Reads median_ns of every benchmark object; only the flat objects bench writes are supported.
+static bool parseResults(const std::string& json, std::map<std::string, double>& results) {
+    size_t pos = json.find("\"benchmarks\"");
+    if (pos == std::string::npos) {
+        return false;
+    }
+    while ((pos = json.find('{', pos)) != std::string::npos) {
+        size_t end = json.find('}', pos);
+        size_t name_key = json.find("\"name\"", pos);
+        if (end == std::string::npos || name_key == std::string::npos || name_key > end) {
+            return false;
+        }
+        size_t name_begin = json.find('"', json.find(':', name_key)) + 1;
+        size_t name_end = json.find('"', name_begin);
+        double median_ns = 0;
+        if (!readNumberField(json, pos, end, "median_ns", median_ns)) {
+            return false;
+        }
+        results[json.substr(name_begin, name_end - name_begin)] = median_ns;
+        pos = end;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " BASELINE.json CURRENT.json [--tolerance=0.10]"
+                  << std::endl;
+        return 2;
+    }
+
+    double tolerance = 0.10;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--tolerance=", 0) == 0) {
+            tolerance = std::stod(arg.substr(std::string("--tolerance=").size()));
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    std::map<std::string, double> baseline;
+    std::map<std::string, double> current;
+    for (auto [filename, results] : {std::pair{argv[1], &baseline}, std::pair{argv[2], &current}}) {
+        std::string json;
+        if (!readFile(filename, json) || !parseResults(json, *results)) {
+            std::cerr << "Cannot read benchmark results from " << filename << std::endl;
+            return 2;
+        }
+    }
+    if (baseline.empty()) {
+        std::cerr << "Baseline " << argv[1] << " has no benchmark cases; record it with "
+                  << "`make bench-baseline` on the reference machine" << std::endl;
+        return 2;
+    }
+
+    size_t regressions = 0;
+    std::printf("%-40s %14s %14s %9s  %s\n", "benchmark", "baseline ns", "current ns", "delta",
+                "status");
+    for (const auto& [name, current_ns] : current) {
+        auto it = baseline.find(name);
+        if (it == baseline.end()) {
+            std::printf("%-40s %14s %14.0f %9s  %s\n", name.c_str(), "-", current_ns, "-", "new");
+            continue;
+        }
+        double delta = it->second > 0 ? current_ns / it->second - 1 : 0;
+        const char* status = "ok";
+        if (delta > tolerance) {
+            status = "REGRESSION";
+            ++regressions;
+        } else if (delta < -tolerance) {
+            status = "faster";
+        }
+        std::printf("%-40s %14.0f %14.0f %+8.1f%%  %s\n", name.c_str(), it->second, current_ns,
+                    delta * 100, status);
+    }
+    size_t missing = 0;
+    for (const auto& [name, baseline_ns] : baseline) {
+        if (current.find(name) == current.end()) {
+            ++missing;
+            std::printf("%-40s %14.0f %14s %9s  %s\n", name.c_str(), baseline_ns, "-", "-",
+                        "MISSING");
+        }
+    }
+
+    std::printf("\n%zu regression(s) above %.1f%% tolerance, %zu missing case(s)\n", regressions,
+                tolerance * 100, missing);
+    return regressions > 0 || missing > 0 ? 1 : 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "images.h"
+
+// Encodes and writes finished images on a background I/O thread. At most max_queue_depth images
+// wait in the queue; further submissions block until the writer catches up. A write that fails
+// makes its future throw std::runtime_error.
+class AsyncImageWriter {
+public:
+    explicit AsyncImageWriter(size_t max_queue_depth = 2);
+    ~AsyncImageWriter();
+
+    AsyncImageWriter(const AsyncImageWriter&) = delete;
+    AsyncImageWriter& operator=(const AsyncImageWriter&) = delete;
+
+    std::future<void> saveAsBMP(UncompressedImage img, const std::string& filename);
+    std::future<void> writeUncompressedFile(
+        UncompressedImage img, const std::string& filename, bool delta_coding = false);
+    std::future<void> writeCompressedFile(
+        CompressedImage img, const std::string& filename, uint8_t pyramid_levels = 0);
+
+    void flush();
+
+private:
+    std::future<void> enqueue(std::packaged_task<void()> task);
+    void run();
+
+    size_t max_queue_depth;
+    size_t active_tasks = 0;
+    bool stopping = false;
+    std::deque<std::packaged_task<void()>> queue;
+    std::mutex mutex;
+    std::condition_variable queue_changed;
+    std::thread worker;
+};
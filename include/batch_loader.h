@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "images.h"
+
+struct BatchLoadResult {
+    std::vector<UncompressedImage> images;
+    // One byte per file rather than vector<bool>: loader threads write neighbouring entries.
+    std::vector<uint8_t> loaded;
+    size_t failed_files = 0;
+    double elapsed_seconds = 0;
+    double files_per_second = 0;
+    bool used_io_uring = false;
+};
+
+// Loads many BMP files at once. Opens, stats and reads are submitted through io_uring when the
+// kernel allows it, otherwise whole files are read with pread on a pool of threads. File buffers
+// come from BufferPool, so repeated batches reuse them. Images keep the order of filenames;
+// images that failed to load are empty and have loaded[i] == 0.
+BatchLoadResult loadBMPBatch(
+    const std::vector<std::string>& filenames, size_t queue_depth = 64, size_t threads = 0);
+
+bool decodeBMPBuffer(std::span<const uint8_t> buffer, UncompressedImage& img);
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct BufferPoolStats {
+    uint64_t allocations = 0;
+    uint64_t reused = 0;
+    uint64_t system_allocations = 0;
+    size_t cached_bytes = 0;
+};
+
+// Recycles large short-lived buffers (image planes, file contents, palette tables, the FFT tiles
+// and column sums of transforms) so that steady-state batch work neither calls the general heap
+// nor faults in fresh pages. Every image plane is one block (see ImagePlane), so the plane a
+// transform replaces is the block its next output of the same size reuses. Sizes are rounded up
+// to a power of two of at least MIN_BLOCK_SIZE. Freed blocks go to a small cache of the freeing
+// thread and, when that is full, to a shared depot; they are returned to the system only by
+// trim() or when max_cached_bytes would be exceeded. Blocks of HUGE_PAGE_SIZE and more, which
+// includes the plane of any image from about 700x1000 RGB pixels up, are mapped 2 MiB-aligned and
+// backed by huge pages according to HugePageMode.
+enum class HugePageMode {
+    NONE,
+    // madvise(MADV_HUGEPAGE): the kernel promotes the block to transparent huge pages if it can.
+    TRANSPARENT,
+    // MAP_HUGETLB from the reserved hugetlbfs pool; falls back to TRANSPARENT when the pool is
+    // empty or not configured.
+    EXPLICIT,
+};
+
+class BufferPool {
+public:
+    static constexpr size_t MIN_BLOCK_SIZE = 4096;
+    static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+    static constexpr size_t SIZE_CLASS_COUNT = 36;
+    static constexpr size_t THREAD_CACHE_BLOCKS = 4;
+
+    static BufferPool& instance();
+
+    void* allocate(size_t bytes);
+    void deallocate(void* block, size_t bytes);
+
+    void setMaxCachedBytes(size_t bytes);
+    void setHugePageMode(HugePageMode mode);
+    // Gives every cached block back to the system, including the calling thread's cache; caches
+    // of other threads are released when those threads exit.
+    void trim();
+    BufferPoolStats stats() const;
+
+    static size_t blockSize(size_t bytes);
+
+private:
+    friend class ThreadBufferCache;
+
+    static size_t sizeClass(size_t bytes);
+    void* systemAllocate(size_t block_size);
+    static void systemFree(void* block, size_t block_size);
+    // Moves a block into the depot, or frees it when the pool is over its limit.
+    void release(void* block, size_t size_class);
+
+    std::mutex depot_mutex;
+    std::array<std::vector<void*>, SIZE_CLASS_COUNT> depot;
+    std::atomic<size_t> max_cached_bytes{256ull << 20};
+    std::atomic<size_t> cached_bytes{0};
+    std::atomic<HugePageMode> huge_page_mode{HugePageMode::TRANSPARENT};
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> reused{0};
+    std::atomic<uint64_t> system_allocations{0};
+};
+
+// Standard allocator over BufferPool, for containers that hold large buffers.
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    PoolAllocator() = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(BufferPool::instance().allocate(count * sizeof(T)));
+    }
+    void deallocate(T* data, size_t count) {
+        BufferPool::instance().deallocate(data, count * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const { return true; }
+};
+
+template <typename T>
+using PooledVector = std::vector<T, PoolAllocator<T>>;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <fstream>
 #include <functional>
@@ -38,5 +39,9 @@ struct ColorHash {
 int64_t colorDistanceSq(const ColorRGB& color1, const ColorRGB& color2);
 
 uint8_t colorToGrayscale(const ColorRGB& color);
+// Writes colorToGrayscale() of count colors to gray, vectorized where the CPU allows it.
+void toGrayscaleRow(const ColorRGB* colors, uint8_t* gray, size_t count);
+// Writes count gray values to colors as ColorRGB{g, g, g}.
+void grayToColorRow(const uint8_t* gray, ColorRGB* colors, size_t count);
 
-ColorRGB readFromFileStream(std::fstream& stream);
+ColorRGB readFromFileStream(std::istream& stream);
@@ -10,11 +10,13 @@
 
 uint8_t findClosestColorId(const ColorRGB& color, const std::map<uint8_t, ColorRGB>& colorTable);
 
-void saveAsBMP(const UncompressedImage& img, const std::string& filename);
+// The writers return false when the file could not be written.
+bool saveAsBMP(const UncompressedImage& img, const std::string& filename);
 UncompressedImage loadFromBMP(const std::string& filename);
 
-UncompressedImage readUncompressedFile(const std::string& filename);
-void writeUncompressedFile(const std::string& filename, const UncompressedImage& file);
+UncompressedImage readUncompressedFile(const std::string& filename, bool compact_grayscale = false);
+bool writeUncompressedFile(
+    const std::string& filename, const UncompressedImage& file, bool delta_coding = false);
 
 CompressedImage toCompressed(
     const UncompressedImage& img, const std::map<uint8_t, ColorRGB>& color_table = {},
@@ -22,6 +24,9 @@ CompressedImage toCompressed(
 UncompressedImage toUncompressed(const CompressedImage& img);
 
 CompressedImage readCompressedFile(const std::string& filename);
-void writeCompressedFile(const std::string& filename, const CompressedImage& file);
+bool writeCompressedFile(
+    const std::string& filename, const CompressedImage& file, uint8_t pyramid_levels = 0);
+
+CompressedImage readLevel(const std::string& filename, uint8_t level);
 
 ColorRGB getColor(const CompressedImage& img, int x, int y);
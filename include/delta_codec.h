@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "colors.h"
+#include "image_plane.h"
+
+// Lossless coding used by RAWIMAGE v2: optional YCoCg-R color transform, MED prediction of every
+// plane and a canonical Huffman code per plane.
+std::vector<uint8_t> encodeDeltaImage(
+    const ImagePlane<ColorRGB>& pixels, uint32_t width, uint32_t height,
+    bool is_grayscale, bool color_transform = true);
+
+bool decodeDeltaImage(
+    const std::vector<uint8_t>& payload, uint32_t width, uint32_t height, bool is_grayscale,
+    bool color_transform, ImagePlane<ColorRGB>& pixels);
+
+std::vector<uint8_t> encodeDeltaGrayImage(
+    const ImagePlane<uint8_t>& gray, uint32_t width, uint32_t height);
+
+bool decodeDeltaGrayImage(
+    const std::vector<uint8_t>& payload, uint32_t width, uint32_t height,
+    ImagePlane<uint8_t>& gray);
@@ -1,14 +1,88 @@
 #pragma once
 
+#include <atomic>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 #include <colors.h>
 
-extern struct GlobalLogFile global_log_file;
+enum class Severity { INFO, WARNING, ERROR, CRITICAL };
+
+enum class LogOverflowPolicy { DROP, BLOCK };
+
+struct LogContext {
+    std::string job_id;
+    std::string image_name;
+};
+
+// Attaches a job context to every record logged by the current thread while it is alive.
+class ScopedLogContext {
+public:
+    explicit ScopedLogContext(LogContext context);
+    ~ScopedLogContext();
+
+    ScopedLogContext(const ScopedLogContext&) = delete;
+    ScopedLogContext& operator=(const ScopedLogContext&) = delete;
+
+private:
+    LogContext previous;
+};
+
+class AsyncLogQueue;
+struct ThreadLogBuffer;
+
+// Every thread formats its records into its own buffer, so logging from several threads only
+// takes the file lock when a buffer is full, on ERROR and above, and on flush.
+class Logger {
+public:
+    Logger();
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    void open(const std::string& filename, bool verbose = false);
+    void close();
+    void flush();
+
+    bool isEnabled(Severity severity) const;
+    void log(const std::string& message, Severity severity, int exit_code = 0);
+
+    // Moves writes to the log file onto a background thread. Callers only copy the formatted line
+    // into a bounded ring of `capacity` records; when it is full the line is dropped or the caller
+    // waits, depending on the policy. CRITICAL messages are still written synchronously after the
+    // queue is drained. Must not be called concurrently with logging.
+    void enableAsync(size_t capacity, LogOverflowPolicy policy);
+    void disableAsync();
+    size_t droppedMessages() const;
+
+private:
+    friend struct ThreadLogBuffer;
+
+    ThreadLogBuffer& threadBuffer();
+    void flushThreadBuffers();
+    void writeToFile(std::string_view data);
+
+    uint64_t id;
+    std::fstream file;
+    std::mutex file_mutex;
+    std::atomic<bool> verbose{false};
+    std::mutex buffers_mutex;
+    std::vector<std::shared_ptr<ThreadLogBuffer>> buffers;
+    std::unique_ptr<AsyncLogQueue> async_queue;
+};
+
+Logger& globalLogger();
 
 void openLogFile(const std::string& filename, bool verbose = false);
 void closeLogFile();
 
-enum class Severity { INFO, WARNING, ERROR, CRITICAL };
+void enableAsyncLogging(size_t capacity = 1024, LogOverflowPolicy policy = LogOverflowPolicy::DROP);
+void disableAsyncLogging();
+size_t droppedLogMessages();
 
 void handleLogMessage(
     const std::string& message, Severity severity, int exit_code, std::fstream& output);
@@ -17,3 +91,43 @@ void handleLogMessage(
     const std::string& message, Severity severity = Severity::INFO, int exit_code = 0);
 
 void handleLogMessage(const std::string& message);
+
+// Severity below which LOG_* calls are compiled out, as a number: 0 keeps INFO, 1 keeps WARNING and
+// above, 2 keeps ERROR and above. Set with -DMIN_LOG_SEVERITY (LOG_LEVEL in the Makefile).
+#ifndef MIN_LOG_SEVERITY
+#define MIN_LOG_SEVERITY 0
+#endif
+
+inline constexpr Severity COMPILED_MIN_SEVERITY = static_cast<Severity>(MIN_LOG_SEVERITY);
+
+inline void appendLogArgument(std::string& out, std::string_view value) { out += value; }
+
+inline void appendLogArgument(std::string& out, char value) { out += value; }
+
+template <typename T>
+    requires std::is_arithmetic_v<T>
+void appendLogArgument(std::string& out, T value) {
+    out += std::to_string(value);
+}
+
+template <typename... Args>
+std::string formatLogMessage(const Args&... args) {
+    std::string message;
+    (appendLogArgument(message, args), ...);
+    return message;
+}
+
+// The arguments are concatenated into a message only when the severity survives both the
+// compile-time and the runtime filter, so disabled calls cost nothing.
+#define LOG_MESSAGE(severity, ...)                                                             \
+    do {                                                                                       \
+        if constexpr ((severity) >= COMPILED_MIN_SEVERITY) {                                   \
+            if (globalLogger().isEnabled(severity)) {                                          \
+                globalLogger().log(formatLogMessage(__VA_ARGS__), severity);                   \
+            }                                                                                  \
+        }                                                                                      \
+    } while (false)
+
+#define LOG_INFO(...) LOG_MESSAGE(Severity::INFO, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_MESSAGE(Severity::WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_MESSAGE(Severity::ERROR, __VA_ARGS__)
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+
+// In-place iterative radix-2 FFT of n complex values; n must be a power of two. The inverse
+// transform is not normalized: inverse(forward(x)) == n * x.
+void fft(std::complex<double>* data, size_t n, bool inverse = false);
+
+// Transforms every row and then every column of a row-major rows x columns array in place; both
+// sizes must be powers of two.
+void fft2D(std::complex<double>* data, size_t rows, size_t columns, bool inverse = false);
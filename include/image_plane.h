@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "buffer_pool.h"
+
+// Pixels of one image plane in a single BufferPool block, rows stored back to back without
+// padding. Indexing and iteration give rows as spans, so code reads as with the
+// std::vector<std::vector<T>> rows it replaces. A plane that is replaced by a transform's output
+// goes back to the pool, and the next transform of the same size takes the block over instead of
+// faulting in fresh pages. Planes of BufferPool::HUGE_PAGE_SIZE and more are backed by huge pages
+// according to the pool's HugePageMode.
+template <typename T>
+class ImagePlane {
+    static_assert(std::is_trivially_copyable_v<T>, "ImagePlane copies pixels as bytes");
+
+public:
+    template <typename Value>
+    class RowIterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = std::span<Value>;
+        using difference_type = std::ptrdiff_t;
+        using reference = std::span<Value>;
+        using pointer = void;
+
+        RowIterator() = default;
+        RowIterator(Value* first_row, size_t row_length, size_t y)
+            : first_row(first_row), row_length(row_length), y(y) {}
+
+        std::span<Value> operator*() const { return {first_row + y * row_length, row_length}; }
+        std::span<Value> operator[](difference_type offset) const { return *(*this + offset); }
+
+        RowIterator& operator++() { ++y; return *this; }
+        RowIterator operator++(int) { RowIterator previous = *this; ++y; return previous; }
+        RowIterator& operator--() { --y; return *this; }
+        RowIterator operator--(int) { RowIterator previous = *this; --y; return previous; }
+        RowIterator& operator+=(difference_type offset) { y += offset; return *this; }
+        RowIterator& operator-=(difference_type offset) { y -= offset; return *this; }
+        friend RowIterator operator+(RowIterator it, difference_type offset) { return it += offset; }
+        friend RowIterator operator+(difference_type offset, RowIterator it) { return it += offset; }
+        friend RowIterator operator-(RowIterator it, difference_type offset) { return it -= offset; }
+        friend difference_type operator-(const RowIterator& a, const RowIterator& b) {
+            return static_cast<difference_type>(a.y) - static_cast<difference_type>(b.y);
+        }
+        friend bool operator==(const RowIterator& a, const RowIterator& b) { return a.y == b.y; }
+        friend auto operator<=>(const RowIterator& a, const RowIterator& b) { return a.y <=> b.y; }
+
+    private:
+        Value* first_row = nullptr;
+        size_t row_length = 0;
+        size_t y = 0;
+    };
+
+    using iterator = RowIterator<T>;
+    using const_iterator = RowIterator<const T>;
+
+    ImagePlane() = default;
+
+    // The pixels are left uninitialized: the first write to every page is made by the band of
+    // rows that fills it, which places the page on that thread's NUMA node. A block reused from
+    // the pool keeps the pages of its previous use.
+    ImagePlane(size_t row_length, size_t row_count)
+        : row_length(row_length), row_count(row_count) {
+        allocate();
+    }
+
+    ImagePlane(size_t row_length, size_t row_count, const T& value)
+        : ImagePlane(row_length, row_count) {
+        std::fill(block, block + pixelCount(), value);
+    }
+
+    // Copies rows of equal length.
+    ImagePlane(const std::vector<std::vector<T>>& rows)
+        : row_length(rows.empty() ? 0 : rows[0].size()), row_count(rows.size()) {
+        for (const auto& row : rows) {
+            if (row.size() != row_length) {
+                throw std::invalid_argument("Rows of an image plane must have equal length");
+            }
+        }
+        allocate();
+        for (size_t y = 0; y < row_count; ++y) {
+            std::copy(rows[y].begin(), rows[y].end(), (*this)[y].begin());
+        }
+    }
+
+    ImagePlane(const ImagePlane& other) : row_length(other.row_length), row_count(other.row_count) {
+        allocate();
+        if (pixelCount() > 0) {
+            std::memcpy(block, other.block, pixelCount() * sizeof(T));
+        }
+    }
+
+    ImagePlane(ImagePlane&& other) noexcept
+        : block(std::exchange(other.block, nullptr)),
+          row_length(std::exchange(other.row_length, 0)),
+          row_count(std::exchange(other.row_count, 0)) {}
+
+    ImagePlane& operator=(const ImagePlane& other) {
+        if (this != &other) {
+            ImagePlane copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    ImagePlane& operator=(ImagePlane&& other) noexcept {
+        ImagePlane moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    ~ImagePlane() { release(); }
+
+    void swap(ImagePlane& other) noexcept {
+        std::swap(block, other.block);
+        std::swap(row_length, other.row_length);
+        std::swap(row_count, other.row_count);
+    }
+
+    // Number of rows, as for a vector of rows.
+    size_t size() const { return row_count; }
+    bool empty() const { return row_count == 0; }
+    size_t rowLength() const { return row_length; }
+    size_t pixelCount() const { return row_length * row_count; }
+
+    T* data() { return block; }
+    const T* data() const { return block; }
+    // All rows as one run of pixels.
+    std::span<T> pixels() { return {block, pixelCount()}; }
+    std::span<const T> pixels() const { return {block, pixelCount()}; }
+
+    std::span<T> operator[](size_t y) { return {block + y * row_length, row_length}; }
+    std::span<const T> operator[](size_t y) const { return {block + y * row_length, row_length}; }
+    std::span<T> front() { return (*this)[0]; }
+    std::span<const T> front() const { return (*this)[0]; }
+    std::span<T> back() { return (*this)[row_count - 1]; }
+    std::span<const T> back() const { return (*this)[row_count - 1]; }
+
+    iterator begin() { return {block, row_length, 0}; }
+    iterator end() { return {block, row_length, row_count}; }
+    const_iterator begin() const { return {block, row_length, 0}; }
+    const_iterator end() const { return {block, row_length, row_count}; }
+
+    void clear() {
+        release();
+        row_length = 0;
+        row_count = 0;
+    }
+
+    bool operator==(const ImagePlane& other) const {
+        return row_length == other.row_length && row_count == other.row_count
+            && std::equal(block, block + pixelCount(), other.block);
+    }
+
+private:
+    void allocate() {
+        if (pixelCount() > 0) {
+            block = PoolAllocator<T>().allocate(pixelCount());
+        }
+    }
+
+    void release() {
+        if (block != nullptr) {
+            PoolAllocator<T>().deallocate(block, pixelCount());
+            block = nullptr;
+        }
+    }
+
+    T* block = nullptr;
+    size_t row_length = 0;
+    size_t row_count = 0;
+};
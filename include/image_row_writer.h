@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "colors.h"
+
+// Writes a BMP, RAWIMAGE v1 or CMPRIMAGE file row by row, so an image never has to be held in
+// memory. open*() writes the header, writeRow() takes rows from top to bottom and finish() writes
+// the end signature and closes the file. Every call returns false, with the reason logged, once
+// the file cannot be written or the rows do not match the header.
+class ImageRowWriter {
+public:
+    // BMP stores the file size in 32 bits, so openBMP() rejects images whose file would reach
+    // 4 GiB. With 24-bit pixels a 32K x 32K image takes 3 GiB and still fits.
+    static constexpr uint64_t MAX_BMP_FILE_SIZE = UINT32_MAX;
+    static uint64_t bmpFileSize(uint32_t width, uint32_t height);
+
+    // Writes a top-down 24-bit BMP.
+    bool openBMP(const std::string& filename, uint32_t width, uint32_t height);
+    // Rows of a grayscale image keep the red channel of every pixel.
+    bool openRaw(const std::string& filename, uint32_t width, uint32_t height, bool is_grayscale);
+    // The palette holds 1 to 256 colors and is padded with black to a power of two.
+    bool openCompressed(
+        const std::string& filename, uint32_t width, uint32_t height,
+        const std::vector<ColorRGB>& palette);
+
+    // BMP and RAWIMAGE rows.
+    bool writeRow(std::span<const ColorRGB> row);
+    // CMPRIMAGE rows of palette ids.
+    bool writeRow(std::span<const uint8_t> ids);
+
+    bool finish();
+
+private:
+    enum class Format { BMP, RAWIMAGE, CMPRIMAGE };
+
+    bool open(const std::string& filename, Format format, uint32_t width, uint32_t height);
+    // Counts the row when the writer is open, the row suits the format and the image has room for it.
+    bool checkRow(bool matches_format, size_t row_length);
+    bool fail(const std::string& message);
+
+    std::ofstream out;
+    std::string filename;
+    Format format = Format::BMP;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t rows_written = 0;
+    bool is_grayscale = false;
+    bool failed = true;
+    std::vector<uint8_t> bytes;
+};
@@ -1,18 +1,41 @@
+#include <array>
 #include <vector>
 #include <cstdint>
+#include <utility>
 
 #include "colors.h"
 #include "compressor_funcs.h"
 
 void rotate(UncompressedImage& img, int angle, ColorRGB fill_color={0, 0, 0},
 bool smart_gap_interpolation = false);
+// Moves palette ids instead of colors. Any angle is supported: other than right-angle rotations
+// take the nearest source pixel (so there are no gaps to interpolate) and put the fill color into
+// the palette, or use the closest palette color when all 256 ids are taken.
+void rotate(CompressedImage& img, int angle, ColorRGB fill_color={0, 0, 0},
+bool smart_gap_interpolation = false);
 
 
+// Correlates the image with a rectangular kernel of any size, anchored at (rows / 2, columns / 2),
+// replicating border pixels; each channel becomes clamp(sum / divisor, 0, 255). Kernels whose shape
+// makes it cheaper for the image size go through a tiled FFT with the same integer results.
 void applyKernel(
     UncompressedImage& img, const std::vector<std::vector<int>>& kernel, int divisor = 1);
 
 void sharpen(UncompressedImage& img);
 void gaussianBlurApprox(UncompressedImage& img, bool hard_blur=false);
+
+constexpr int MAX_BOX_BLUR_RADIUS = 100;
+
+// Mean of the (2 * radius + 1)^2 square around every pixel, borders replicated; the same result
+// as applyKernel with a kernel of ones and their count as divisor, at a cost independent of
+// radius (1..MAX_BOX_BLUR_RADIUS).
+void boxBlur(UncompressedImage& img, int radius);
+// Largest sigma whose three boxes all fit within MAX_BOX_BLUR_RADIUS.
+constexpr double MAX_GAUSSIAN_SIGMA = 100;
+
+// Gaussian blur of the given standard deviation (up to MAX_GAUSSIAN_SIGMA) approximated by three
+// box blurs; sigma below about 0.8 needs boxes narrower than 3 pixels and leaves the image as it is.
+void gaussianBlur(UncompressedImage& img, double sigma);
 void edgeDetect(UncompressedImage& img);
 
 void negative(UncompressedImage& img);
@@ -21,8 +44,45 @@ void negative(CompressedImage& img);
 void toGrayscale(UncompressedImage& img);
 void toGrayscale(CompressedImage& img);
 
+// Output value of every 8-bit channel value.
+using ChannelLUT = std::array<uint8_t, 256>;
+
+// Maps the red, green and blue channels through their tables in place; vectorized with AVX-512
+// VBMI byte permutes where the CPU has them. A compressed image maps its palette only.
+void applyChannelLUT(
+    UncompressedImage& img, const ChannelLUT& lut_r, const ChannelLUT& lut_g, const ChannelLUT& lut_b);
+void applyChannelLUT(UncompressedImage& img, const ChannelLUT& lut);
+void applyChannelLUT(
+    CompressedImage& img, const ChannelLUT& lut_r, const ChannelLUT& lut_g, const ChannelLUT& lut_b);
+void applyChannelLUT(CompressedImage& img, const ChannelLUT& lut);
+
+ChannelLUT negativeLUT();
+// 255 * (v / 255)^(1 / gamma): gamma above 1 brightens the midtones.
+ChannelLUT gammaLUT(double gamma);
+// Stretches [black, white] to the full range with a midtone gamma; values outside are clipped.
+ChannelLUT levelsLUT(uint8_t black, uint8_t white, double gamma = 1.0);
+// Scales the distance from the middle gray by factor: above 1 raises contrast, below lowers it.
+ChannelLUT contrastLUT(double factor);
+
+// Keeps one id per color and renumbers the kept ids densely from 0 in their original order.
+// Returns the number of dropped ids; the index plane is rewritten only if there were any.
+size_t mergeDuplicateColors(CompressedImage& img);
+
 // template methods below
 
+// Runs a per-color function (ColorRGB -> ColorRGB) over the palette only, never over the pixels.
+// Colors that become equal are merged lazily: see mergeDuplicateColors.
+template <typename Fn>
+void applyPointOp(CompressedImage& img, Fn&& fn) {
+    img.transformPalette(std::forward<Fn>(fn));
+}
+
+// In place, without heap allocations: rows are swapped or reversed where they are.
 template <typename Image>
-void mirror(Image& img, bool horizontal = false) {
-}
\ No newline at end of file
+void mirror(Image& img, bool horizontal = false);
+
+template <>
+void mirror(UncompressedImage& img, bool horizontal);
+
+template <>
+void mirror(CompressedImage& img, bool horizontal);
\ No newline at end of file
@@ -1,19 +1,23 @@
 #pragma once
 
 #include <map>
+#include <span>
 #include <unordered_map>
 #include <vector>
 #include <cstdint>
 #include <string>
 #include <stdexcept>
 #include "colors.h"
+#include "image_plane.h"
 
 class UncompressedImage {
 private:
     uint32_t width;
     uint32_t height;
     bool is_grayscale;
-    std::vector<std::vector<ColorRGB>> image_data;
+    ImagePlane<ColorRGB> image_data;
+    // Single-channel rows of a grayscale image; when not empty, image_data is empty.
+    ImagePlane<uint8_t> gray_data;
 
 public:
     UncompressedImage();
@@ -22,16 +26,35 @@ public:
     uint32_t getWidth() const;
     uint32_t getHeight() const;
     bool getIsGrayscale() const;
-    const std::vector<std::vector<ColorRGB>>& getImageData() const;
+    bool hasGrayStorage() const;
+    const ImagePlane<ColorRGB>& getImageData() const;
+    const ImagePlane<uint8_t>& getGrayData() const;
+    // For in-place transforms; the plane must keep height rows of width pixels.
+    ImagePlane<ColorRGB>& getMutableImageData();
+    ImagePlane<uint8_t>& getMutableGrayData();
+    std::span<ColorRGB> getMutableRow(uint32_t y);
+    std::span<uint8_t> getMutableGrayRow(uint32_t y);
+    ColorRGB getPixel(uint32_t x, uint32_t y) const;
+
+    // Move the rows out, leaving the image without pixel data until they are set again.
+    ImagePlane<ColorRGB> takeImageData();
+    ImagePlane<uint8_t> takeGrayData();
 
     void setWidth(uint32_t w);
     void setHeight(uint32_t h);
     void setIsGrayscale(bool gray);
-    void setImageData(const std::vector<std::vector<ColorRGB>>& data);
+    // A plane passed by rvalue is taken over without copying; rows given as vectors are copied.
+    void setImageData(const ImagePlane<ColorRGB>& data);
+    void setImageData(ImagePlane<ColorRGB>&& data);
+    void setGrayData(const ImagePlane<uint8_t>& data);
+    void setGrayData(ImagePlane<uint8_t>&& data);
     void setPixel(uint32_t x, uint32_t y, const ColorRGB& color);
 
-    bool readFromFile(const std::string& filename);
-    bool writeToFile(const std::string& filename) const;
+    void compactGrayscale();
+    void expandGrayscale();
+
+    bool readFromFile(const std::string& filename, bool compact_grayscale = false);
+    bool writeToFile(const std::string& filename, bool delta_coding = false) const;
 };
 
 class CompressedImage {
@@ -40,7 +63,7 @@ private:
     uint32_t height;
     std::map<uint8_t, ColorRGB> id_to_color;                    
     std::unordered_map<ColorRGB, uint8_t, ColorHash> color_to_id; 
-    std::vector<std::vector<uint8_t>> image_data;
+    ImagePlane<uint8_t> image_data;
 
 public:
     CompressedImage();
@@ -50,17 +73,40 @@ public:
     uint32_t getHeight() const;
     const std::map<uint8_t, ColorRGB>& getIdToColor() const;
     const std::unordered_map<ColorRGB, uint8_t, ColorHash>& getColorToId() const;
-    const std::vector<std::vector<uint8_t>>& getImageData() const;
+    const ImagePlane<uint8_t>& getImageData() const;
+    // For in-place transforms; the plane must keep height rows of width ids.
+    ImagePlane<uint8_t>& getMutableImageData();
+    std::span<uint8_t> getMutableRow(uint32_t y);
+
+    // Move the index rows out, leaving the image without pixel data until they are set again.
+    ImagePlane<uint8_t> takeImageData();
 
     void setWidth(uint32_t w);
     void setHeight(uint32_t h);
     void setIdToColor(const std::map<uint8_t, ColorRGB>& table);
+    void setIdToColor(std::map<uint8_t, ColorRGB>&& table);
     void setColorToId(const std::unordered_map<ColorRGB, uint8_t, ColorHash>& table);
-    void setImageData(const std::vector<std::vector<uint8_t>>& data);
+    void setColorToId(std::unordered_map<ColorRGB, uint8_t, ColorHash>&& table);
+    void setImageData(const ImagePlane<uint8_t>& data);
+    void setImageData(ImagePlane<uint8_t>&& data);
     void setPixel(uint32_t x, uint32_t y, uint8_t color_id);
 
+    // Replaces every palette color with fn(color) in place. Ids that end up with the same color keep
+    // their pixels; color_to_id then points to the smallest of them.
+    template <typename Fn>
+    void transformPalette(Fn&& fn);
+
     bool readFromFile(const std::string& filename);
     bool writeToFile(const std::string& filename) const;
 };
 
+template <typename Fn>
+void CompressedImage::transformPalette(Fn&& fn) {
+    color_to_id.clear();
+    for (auto& [id, color] : id_to_color) {
+        color = fn(static_cast<const ColorRGB&>(color));
+        color_to_id.emplace(color, id);
+    }
+}
+
 bool matchUncompressedImages(const UncompressedImage& img1, const UncompressedImage& img2, bool verbose = true);
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class MetricsFormat { JSON, PROMETHEUS };
+
+struct StageStats {
+    std::string name;
+    uint64_t count = 0;
+    double p50_seconds = 0;
+    double p99_seconds = 0;
+    double total_seconds = 0;
+    uint64_t bytes = 0;
+    uint64_t pixels = 0;
+    double megapixels_per_second = 0;
+};
+
+// Durations are kept in a log-linear histogram: 8 buckets per power of two of nanoseconds, so
+// percentiles are accurate to about 6% without storing individual samples.
+class StageMetrics {
+public:
+    static constexpr size_t SUB_BUCKETS = 8;
+    static constexpr size_t BUCKET_COUNT = 64 * SUB_BUCKETS;
+
+    explicit StageMetrics(std::string name);
+
+    void record(uint64_t nanoseconds, uint64_t pixels, uint64_t bytes);
+    StageStats stats() const;
+    void reset();
+
+private:
+    static size_t bucketIndex(uint64_t nanoseconds);
+    static double bucketMidpoint(size_t index);
+    double quantile(double q, uint64_t count) const;
+
+    std::string name;
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> total_nanoseconds{0};
+    std::atomic<uint64_t> total_pixels{0};
+    std::atomic<uint64_t> total_bytes{0};
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+};
+
+class MetricsRegistry {
+public:
+    static MetricsRegistry& instance();
+
+    StageMetrics& stage(const std::string& name);
+    std::vector<StageStats> snapshot() const;
+    void reset();
+
+    void exportJSON(std::ostream& out) const;
+    void exportPrometheus(std::ostream& out) const;
+    bool exportToFile(const std::string& filename, MetricsFormat format) const;
+
+private:
+    mutable std::mutex mutex;
+    std::map<std::string, std::unique_ptr<StageMetrics>> stages;
+};
+
+// Writes all collected stage metrics to the file when the program exits.
+void exportMetricsOnExit(const std::string& filename, MetricsFormat format = MetricsFormat::JSON);
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(StageMetrics& stage, uint64_t pixels = 0, uint64_t bytes = 0);
+    ~ScopedTimer();
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    // For stages that only learn their size while running, e.g. file readers.
+    void setWork(uint64_t pixels, uint64_t bytes);
+
+private:
+    StageMetrics& stage;
+    uint64_t pixels;
+    uint64_t bytes;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define METRICS_CONCAT_IMPL(a, b) a##b
+#define METRICS_CONCAT(a, b) METRICS_CONCAT_IMPL(a, b)
+
+// Times the rest of the enclosing scope as stage `name`. The stage is looked up once per call site.
+#define STAGE_TIMER(timer, name, ...)                                                          \
+    static StageMetrics& METRICS_CONCAT(timer, _stage) = MetricsRegistry::instance().stage(name); \
+    ScopedTimer timer(METRICS_CONCAT(timer, _stage) __VA_OPT__(, ) __VA_ARGS__)
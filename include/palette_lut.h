@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "colors.h"
+
+// Nearest-palette id of every 24-bit color, 16 MiB of uint8_t. Entries equal findClosestColorId()
+// for the same palette, including the choice of the smallest id between equally near colors.
+// A table is immutable once built, so one instance can be shared by any number of threads.
+class PaletteLUT {
+public:
+    static constexpr size_t ENTRY_COUNT = size_t{1} << 24;
+    // Pixels converted with one palette before toCompressed() builds its table. A build costs
+    // about as much as hashing this many pixels, and far less than searching them.
+    static constexpr uint64_t BUILD_THRESHOLD_PIXELS = uint64_t{1} << 22;
+    // Tables kept by the shared cache, 16 MiB each.
+    static constexpr size_t MAX_SHARED_TABLES = 4;
+
+    ~PaletteLUT();
+    PaletteLUT(const PaletteLUT&) = delete;
+    PaletteLUT& operator=(const PaletteLUT&) = delete;
+
+    static std::shared_ptr<const PaletteLUT> build(
+        const std::map<uint8_t, ColorRGB>& palette, size_t threads = 0);
+    // Maps a table written by save(); returns nullptr when the file is missing or malformed.
+    static std::shared_ptr<const PaletteLUT> load(const std::string& filename);
+    bool save(const std::string& filename) const;
+
+    // Shared per-palette cache used by toCompressed(). acquire() returns the cached table for
+    // the palette, builds it once the palette has been used for BUILD_THRESHOLD_PIXELS pixels
+    // (counting pixel_count of this call), and returns nullptr until then.
+    static std::shared_ptr<const PaletteLUT> acquire(
+        const std::map<uint8_t, ColorRGB>& palette, uint64_t pixel_count);
+    // Makes a built or loaded table available to acquire().
+    static void share(std::shared_ptr<const PaletteLUT> table);
+    static void clearShared();
+
+    uint8_t lookup(const ColorRGB& color) const {
+        return ids[(static_cast<uint32_t>(color.r) << 16) | (static_cast<uint32_t>(color.g) << 8) | color.b];
+    }
+    const std::map<uint8_t, ColorRGB>& getPalette() const { return palette; }
+
+private:
+    explicit PaletteLUT(const std::map<uint8_t, ColorRGB>& palette);
+
+    std::map<uint8_t, ColorRGB> palette;
+    // A built table lives in a BufferPool block, a loaded one in the file mapping.
+    uint8_t* pooled = nullptr;
+    const uint8_t* ids = nullptr;
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+};
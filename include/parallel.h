@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// Thread count used when a call passes threads == 0; 0 (the default) means
+// std::thread::hardware_concurrency().
+void setDefaultWorkerThreads(size_t threads);
+size_t defaultWorkerThreads();
+
+// Splits [0, count) into contiguous bands of at least min_band items and calls fn(begin, end)
+// for each band on its own thread; the calling thread takes the first band. Output rows that a
+// band allocates and fills itself are first touched by that thread, so on NUMA hosts they land
+// on the node that processes them.
+void parallelForBands(size_t count, size_t min_band, const std::function<void(size_t, size_t)>& fn,
+                      size_t threads = 0);
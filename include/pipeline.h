@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+
+#include "colors.h"
+#include "images.h"
+
+// Chains transforms and runs them in as few passes as possible:
+//   Pipeline().rotate(90).sharpen().grayscale().run(img);
+// All right-angle rotations and mirrors collapse into one of the eight symmetries of the rectangle,
+// which is moved to the front (kernels that it passes are rotated and mirrored along with the image)
+// and executed as one coordinate remap; adjacent double negatives cancel out. Negative and grayscale
+// are applied to rows as they pass, and kernels stream rows through line buffers of the kernel
+// height, so no intermediate image is materialized. A kernel with an even side is anchored off its
+// center and cannot be moved past a rotation or mirror: a chain that has one later is run in parts,
+// and the image is materialized after each such kernel. The result is identical to calling the
+// functions from image_transforms.h one by one.
+class Pipeline {
+public:
+    Pipeline& rotate(int angle, ColorRGB fill_color = {0, 0, 0}, bool smart_gap_interpolation = false);
+    Pipeline& mirror(bool horizontal = false);
+    Pipeline& applyKernel(const std::vector<std::vector<int>>& kernel, int divisor = 1);
+    Pipeline& sharpen();
+    Pipeline& gaussianBlurApprox(bool hard_blur = false);
+    Pipeline& edgeDetect();
+    Pipeline& negative();
+    Pipeline& grayscale();
+
+    void run(UncompressedImage& img) const;
+
+    // Equivalent chain that starts with 0-3 quarter turns and an optional horizontal mirror and
+    // contains no other rotations or mirrors. A chain with a kernel of even side followed by a
+    // rotation or mirror has no such form and is returned unchanged.
+    Pipeline simplified() const;
+
+    size_t size() const;
+    bool empty() const;
+
+private:
+    enum class OperationType { ROTATE_90, MIRROR, KERNEL, NEGATIVE, GRAYSCALE };
+
+    struct Operation {
+        OperationType type;
+        bool horizontal = false;
+        std::vector<std::vector<int>> kernel = {};
+        int divisor = 1;
+    };
+
+    // End of the part of the chain that starts at begin and can be simplified: just after the
+    // first kernel of even side that has a rotation or mirror later, or the end of the chain.
+    size_t splitPoint(size_t begin) const;
+    void execute(UncompressedImage& img) const;
+
+    std::vector<Operation> operations;
+};
+
+// Image handle that records operations instead of applying them; they run as one simplified
+// Pipeline when the image is requested. Rotation by an arbitrary angle is applied immediately,
+// after the operations recorded before it.
+class LazyImage {
+public:
+    explicit LazyImage(UncompressedImage img);
+
+    LazyImage& rotate(int angle, ColorRGB fill_color = {0, 0, 0}, bool smart_gap_interpolation = false);
+    LazyImage& mirror(bool horizontal = false);
+    LazyImage& applyKernel(const std::vector<std::vector<int>>& kernel, int divisor = 1);
+    LazyImage& sharpen();
+    LazyImage& gaussianBlurApprox(bool hard_blur = false);
+    LazyImage& edgeDetect();
+    LazyImage& negative();
+    LazyImage& grayscale();
+
+    size_t pendingOperations() const;
+    const UncompressedImage& evaluate();
+
+private:
+    UncompressedImage image;
+    Pipeline pending;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "colors.h"
+#include "images.h"
+
+struct SyntheticImageOptions {
+    uint32_t width = 1024;
+    uint32_t height = 1024;
+    // Number of distinct colors (at most MAX_PALETTE_SIZE); 0 keeps every color the gradients and
+    // noise produce.
+    uint32_t color_count = 0;
+    // Amplitude of the per-pixel noise as a fraction of the full range, 0..1.
+    double noise = 0;
+    // Strength of the gradients: 0 gives a uniform mid tone, 1 spans the full range.
+    double gradient = 1;
+    // Approximate fraction of the area covered by flat single-color rectangles, 0..1.
+    double flat_fraction = 0;
+    bool grayscale = false;
+    uint64_t seed = 1;
+};
+
+// Deterministic generator of test images: the same options always give the same pixels. Rows
+// do not depend on each other, so images far larger than memory (up to 32K x 32K and beyond) can
+// be produced and written row by row.
+class SyntheticImageGenerator {
+public:
+    static constexpr uint32_t MAX_PALETTE_SIZE = 1 << 16;
+
+    explicit SyntheticImageGenerator(const SyntheticImageOptions& options);
+
+    const SyntheticImageOptions& getOptions() const;
+    bool hasPalette() const;
+    const std::vector<ColorRGB>& getPalette() const;
+
+    void generateRow(uint32_t y, std::vector<ColorRGB>& row) const;
+    // Palette indices of a row; only for generators with a palette.
+    void generateIndexRow(uint32_t y, std::vector<uint32_t>& row) const;
+
+    UncompressedImage generate() const;
+    // Needs a palette of at most 256 colors.
+    CompressedImage generateCompressed() const;
+
+private:
+    struct FlatRegion {
+        uint32_t x0, y0, x1, y1;
+        uint32_t index;
+        ColorRGB color;
+    };
+
+    double channelValue(uint32_t x, uint32_t y, int channel, uint64_t hash) const;
+
+    SyntheticImageOptions options;
+    std::vector<ColorRGB> palette;
+    std::vector<FlatRegion> flat_regions;
+};
@@ -0,0 +1,83 @@
+#include "async_writer.h"
+#include "compressor_funcs.h"
+#include <stdexcept>
+#include <utility>
+
+AsyncImageWriter::AsyncImageWriter(size_t max_queue_depth)
+    : max_queue_depth(max_queue_depth == 0 ? 1 : max_queue_depth), worker([this] { run(); }) {}
+
+AsyncImageWriter::~AsyncImageWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queue_changed.notify_all();
+    worker.join();
+}
+
+std::future<void> AsyncImageWriter::saveAsBMP(UncompressedImage img, const std::string& filename) {
+    return enqueue(std::packaged_task<void()>([img = std::move(img), filename] {
+        if (!::saveAsBMP(img, filename)) {
+            throw std::runtime_error("Не удалось сохранить BMP файл: " + filename);
+        }
+    }));
+}
+
+std::future<void> AsyncImageWriter::writeUncompressedFile(
+    UncompressedImage img, const std::string& filename, bool delta_coding) {
+    return enqueue(std::packaged_task<void()>([img = std::move(img), filename, delta_coding] {
+        if (!::writeUncompressedFile(filename, img, delta_coding)) {
+            throw std::runtime_error("Не удалось записать UncompressedImage файл: " + filename);
+        }
+    }));
+}
+
+std::future<void> AsyncImageWriter::writeCompressedFile(
+    CompressedImage img, const std::string& filename, uint8_t pyramid_levels) {
+    return enqueue(std::packaged_task<void()>([img = std::move(img), filename, pyramid_levels] {
+        if (!::writeCompressedFile(filename, img, pyramid_levels)) {
+            throw std::runtime_error("Не удалось записать CompressedImage файл: " + filename);
+        }
+    }));
+}
+
+void AsyncImageWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    queue_changed.wait(lock, [this] { return queue.empty() && active_tasks == 0; });
+}
+
+std::future<void> AsyncImageWriter::enqueue(std::packaged_task<void()> task) {
+    std::future<void> result = task.get_future();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        queue_changed.wait(lock, [this] { return queue.size() < max_queue_depth; });
+        queue.push_back(std::move(task));
+    }
+    queue_changed.notify_all();
+    return result;
+}
+
+void AsyncImageWriter::run() {
+    while (true) {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queue_changed.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            task = std::move(queue.front());
+            queue.pop_front();
+            ++active_tasks;
+        }
+        queue_changed.notify_all();
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --active_tasks;
+        }
+        queue_changed.notify_all();
+    }
+}
@@ -0,0 +1,544 @@
+#include "batch_loader.h"
+#include "buffer_pool.h"
+#include "error_handlers.h"
+#include "libbmp.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define IMAGE_COMPRESSOR_HAS_IO_URING 1
+#endif
+
+bool decodeBMPBuffer(std::span<const uint8_t> buffer, UncompressedImage& img) {
+    BMPHeader file_header;
+    BMPInfoHeader info_header;
+    if (buffer.size() < sizeof(file_header) + sizeof(info_header)) {
+        return false;
+    }
+    std::memcpy(&file_header, buffer.data(), sizeof(file_header));
+    std::memcpy(&info_header, buffer.data() + sizeof(file_header), sizeof(info_header));
+    // INT32_MIN has no positive counterpart, so it is not a valid top-down height.
+    if (file_header.file_type != 0x4D42 || info_header.width <= 0 || info_header.height == 0
+        || info_header.height == INT32_MIN
+        || (info_header.bit_count != 24 && info_header.bit_count != 32)) {
+        return false;
+    }
+
+    bool is_bottom_up = info_header.height > 0;
+    uint32_t width = info_header.width;
+    uint32_t height = is_bottom_up ? info_header.height : -info_header.height;
+    uint32_t channels = info_header.bit_count / 8;
+    size_t row_stride = static_cast<size_t>(width) * channels;
+    size_t padded_stride = (row_stride + 3) / 4 * 4;
+    // The rows must fit between offset_data and the end of the buffer. Dividing instead of
+    // multiplying keeps the check free of overflow for any header values.
+    if (file_header.offset_data > buffer.size()) {
+        return false;
+    }
+    size_t available = buffer.size() - file_header.offset_data;
+    if (row_stride > available
+        || (height > 1 && (available - row_stride) / (height - 1) < padded_stride)) {
+        return false;
+    }
+
+    ImagePlane<ColorRGB> rows(width, height);
+    for (uint32_t y = 0; y < height; ++y) {
+        uint32_t file_row = is_bottom_up ? height - 1 - y : y;
+        const uint8_t* src = buffer.data() + file_header.offset_data + file_row * padded_stride;
+        for (uint32_t x = 0; x < width; ++x, src += channels) {
+            rows[y][x] = ColorRGB{src[2], src[1], src[0]};
+        }
+    }
+
+    img.setWidth(width);
+    img.setHeight(height);
+    img.setIsGrayscale(false);
+    img.setImageData(std::move(rows));
+    return true;
+}
+
+static bool readWholeFile(const std::string& filename, PooledVector<uint8_t>& buffer) {
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        return false;
+    }
+
+    buffer.resize(file_stat.st_size);
+    size_t done = 0;
+    while (done < buffer.size()) {
+        ssize_t result = pread(fd, buffer.data() + done, buffer.size() - done, done);
+        if (result <= 0) {
+            break;
+        }
+        done += result;
+    }
+    buffer.resize(done);
+    close(fd);
+    return true;
+}
+
+// Decoding allocates the image and reading allocates the file buffer; a failed allocation or any
+// other exception marks the file as failed instead of leaving the loader thread.
+static bool decodeLoadedFile(
+    const std::string& filename, std::span<const uint8_t> buffer, UncompressedImage& img) {
+    try {
+        return decodeBMPBuffer(buffer, img);
+    } catch (const std::exception& e) {
+        handleLogMessage("Не удалось декодировать BMP файл: " + filename + " (" + e.what() + ")",
+                         Severity::ERROR);
+        img = UncompressedImage();
+        return false;
+    }
+}
+
+static bool readAndDecodeFile(
+    const std::string& filename, PooledVector<uint8_t>& buffer, UncompressedImage& img) {
+    try {
+        if (!readWholeFile(filename, buffer)) {
+            return false;
+        }
+    } catch (const std::exception& e) {
+        handleLogMessage("Не удалось прочитать BMP файл: " + filename + " (" + e.what() + ")",
+                         Severity::ERROR);
+        PooledVector<uint8_t>().swap(buffer);
+        return false;
+    }
+    return decodeLoadedFile(filename, buffer, img);
+}
+
+static void loadWithThreadPool(
+    const std::vector<std::string>& filenames, size_t threads, BatchLoadResult& result) {
+    std::atomic<size_t> next_file{0};
+    auto worker = [&] {
+        PooledVector<uint8_t> buffer;
+        for (size_t i = next_file++; i < filenames.size(); i = next_file++) {
+            result.loaded[i] = readAndDecodeFile(filenames[i], buffer, result.images[i]);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; ++i) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+#ifdef IMAGE_COMPRESSOR_HAS_IO_URING
+
+class IoUring {
+public:
+    explicit IoUring(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_fd < 0) {
+            return;
+        }
+
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+        }
+
+        sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd, IORING_OFF_SQ_RING);
+        cq_ring = single_mmap ? sq_ring
+                              : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                                               MAP_SHARED | MAP_POPULATE, ring_fd,
+                                               IORING_OFF_SQES));
+        if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+            release();
+            return;
+        }
+
+        char* sq = static_cast<char*>(sq_ring);
+        char* cq = static_cast<char*>(cq_ring);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        sq_entries = params.sq_entries;
+    }
+
+    ~IoUring() { release(); }
+
+    bool valid() const { return ring_fd >= 0; }
+    unsigned capacity() const { return sq_entries; }
+    // Entries consumed by the kernel whose completions have not been reaped yet.
+    unsigned inFlight() const { return in_flight; }
+    unsigned freeEntries() const {
+        return sq_entries - (local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE));
+    }
+
+    io_uring_sqe* nextSqe() {
+        unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if (local_tail - head >= sq_entries) {
+            return nullptr;
+        }
+        unsigned index = local_tail & sq_mask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array[index] = index;
+        ++local_tail;
+        ++pending_submissions;
+        return sqe;
+    }
+
+    // Submits every queued entry and waits for wait_count completions. The kernel may consume
+    // fewer entries than asked for or be interrupted by a signal; the rest is submitted again.
+    bool submitAndWait(unsigned wait_count) {
+        __atomic_store_n(sq_tail, local_tail, __ATOMIC_RELEASE);
+        do {
+            long result = syscall(__NR_io_uring_enter, ring_fd, pending_submissions, wait_count,
+                                  wait_count > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            if (result == 0 && pending_submissions > 0) {
+                return false;
+            }
+            pending_submissions -= static_cast<unsigned>(result);
+            in_flight += static_cast<unsigned>(result);
+        } while (pending_submissions > 0);
+        return true;
+    }
+
+    // Waits for completions without submitting the queued entries.
+    bool waitForCompletions(unsigned wait_count) {
+        long result = syscall(__NR_io_uring_enter, ring_fd, 0, wait_count, IORING_ENTER_GETEVENTS,
+                              nullptr, 0);
+        return result >= 0 || errno == EINTR;
+    }
+
+    template <typename Fn>
+    void forEachCompletion(Fn&& fn) {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes[head & cq_mask];
+            fn(cqe.user_data, cqe.res);
+            --in_flight;
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    void release() {
+        if (sqes != nullptr && sqes != MAP_FAILED) {
+            munmap(sqes, sqes_size);
+        }
+        if (cq_ring != nullptr && cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+            munmap(cq_ring, cq_ring_size);
+        }
+        if (sq_ring != nullptr && sq_ring != MAP_FAILED) {
+            munmap(sq_ring, sq_ring_size);
+        }
+        if (ring_fd >= 0) {
+            close(ring_fd);
+        }
+        sqes = nullptr;
+        sq_ring = cq_ring = nullptr;
+        ring_fd = -1;
+    }
+
+    int ring_fd = -1;
+    void* sq_ring = nullptr;
+    void* cq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    size_t cq_ring_size = 0;
+    size_t sqes_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned sq_mask = 0;
+    unsigned cq_mask = 0;
+    unsigned sq_entries = 0;
+    unsigned local_tail = 0;
+    unsigned pending_submissions = 0;
+    unsigned in_flight = 0;
+};
+
+enum class FileStage : uint8_t { OPEN_AND_STAT, READ, CLOSE, DONE };
+
+struct FileRequest {
+    FileStage stage = FileStage::OPEN_AND_STAT;
+    int fd = -1;
+    int pending_ops = 0;
+    bool failed = false;
+    struct statx file_statx;
+    PooledVector<uint8_t> buffer;
+    size_t bytes_read = 0;
+};
+
+static constexpr uint64_t OP_OPEN = 0;
+static constexpr uint64_t OP_STATX = 1;
+static constexpr uint64_t OP_READ = 2;
+static constexpr uint64_t OP_CLOSE = 3;
+
+static bool loadWithIoUring(
+    const std::vector<std::string>& filenames, size_t queue_depth, BatchLoadResult& result) {
+    IoUring ring(static_cast<unsigned>(std::max<size_t>(queue_depth, 2)));
+    if (!ring.valid()) {
+        return false;
+    }
+
+    // Every file has at most two requests in flight, so this many files always fit in the ring.
+    size_t max_active_files = ring.capacity() / 2;
+    std::vector<FileRequest> requests(filenames.size());
+    size_t next_file = 0;
+    size_t active_files = 0;
+    size_t finished_files = 0;
+    bool ring_failed = false;
+
+    // Makes room for count entries, flushing a full submission queue to the kernel first, so
+    // the following nextSqe() calls cannot return nullptr.
+    auto reserveSqes = [&](unsigned count) {
+        if (ring.freeEntries() < count && !ring.submitAndWait(0)) {
+            ring_failed = true;
+        }
+        ring_failed |= ring.freeEntries() < count;
+        return !ring_failed;
+    };
+
+    auto submitRead = [&](size_t i) {
+        FileRequest& request = requests[i];
+        if (!reserveSqes(1)) {
+            return;
+        }
+        io_uring_sqe* sqe = ring.nextSqe();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = request.fd;
+        sqe->addr = reinterpret_cast<uint64_t>(request.buffer.data() + request.bytes_read);
+        sqe->len = static_cast<uint32_t>(request.buffer.size() - request.bytes_read);
+        sqe->off = request.bytes_read;
+        sqe->user_data = (i << 2) | OP_READ;
+        request.pending_ops = 1;
+    };
+
+    auto submitClose = [&](size_t i) {
+        FileRequest& request = requests[i];
+        request.stage = FileStage::CLOSE;
+        if (!reserveSqes(1)) {
+            return;
+        }
+        io_uring_sqe* sqe = ring.nextSqe();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = request.fd;
+        sqe->user_data = (i << 2) | OP_CLOSE;
+        request.pending_ops = 1;
+    };
+
+    auto finishFile = [&](size_t i) {
+        FileRequest& request = requests[i];
+        request.stage = FileStage::DONE;
+        if (request.failed) {
+            // Kernels without the needed opcodes end up here; the plain path still loads the file.
+            result.loaded[i] = readAndDecodeFile(filenames[i], request.buffer, result.images[i]);
+        } else {
+            request.buffer.resize(request.bytes_read);
+            result.loaded[i] = decodeLoadedFile(filenames[i], request.buffer, result.images[i]);
+        }
+        PooledVector<uint8_t>().swap(request.buffer);
+        --active_files;
+        ++finished_files;
+    };
+
+    // Applies one completion to its file; returns true when the file has nothing in flight.
+    auto recordCompletion = [&](uint64_t user_data, int32_t res) {
+        FileRequest& request = requests[user_data >> 2];
+        --request.pending_ops;
+        switch (user_data & 3) {
+            case OP_OPEN:
+                request.fd = res;
+                request.failed |= res < 0;
+                break;
+            case OP_STATX:
+                request.failed |= res < 0;
+                break;
+            case OP_READ:
+                if (res < 0) {
+                    request.failed = true;
+                } else if (res == 0) {
+                    request.buffer.resize(request.bytes_read);
+                } else {
+                    request.bytes_read += res;
+                }
+                break;
+            case OP_CLOSE:
+                request.fd = -1;
+                break;
+        }
+        return request.pending_ops == 0;
+    };
+
+    while (finished_files < filenames.size() && !ring_failed) {
+        while (next_file < filenames.size() && active_files < max_active_files) {
+            if (!reserveSqes(2)) {
+                break;
+            }
+            size_t i = next_file++;
+            io_uring_sqe* open_sqe = ring.nextSqe();
+            open_sqe->opcode = IORING_OP_OPENAT;
+            open_sqe->fd = AT_FDCWD;
+            open_sqe->addr = reinterpret_cast<uint64_t>(filenames[i].c_str());
+            open_sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            open_sqe->user_data = (i << 2) | OP_OPEN;
+
+            io_uring_sqe* statx_sqe = ring.nextSqe();
+            statx_sqe->opcode = IORING_OP_STATX;
+            statx_sqe->fd = AT_FDCWD;
+            statx_sqe->addr = reinterpret_cast<uint64_t>(filenames[i].c_str());
+            statx_sqe->len = STATX_SIZE;
+            statx_sqe->off = reinterpret_cast<uint64_t>(&requests[i].file_statx);
+            statx_sqe->user_data = (i << 2) | OP_STATX;
+
+            requests[i].pending_ops = 2;
+            ++active_files;
+        }
+
+        if (ring_failed || !ring.submitAndWait(1)) {
+            ring_failed = true;
+            break;
+        }
+
+        std::vector<size_t> ready_files;
+        ring.forEachCompletion([&](uint64_t user_data, int32_t res) {
+            if (recordCompletion(user_data, res)) {
+                ready_files.push_back(user_data >> 2);
+            }
+        });
+
+        for (size_t i : ready_files) {
+            FileRequest& request = requests[i];
+            if (request.stage == FileStage::OPEN_AND_STAT) {
+                if (request.failed) {
+                    if (request.fd >= 0) {
+                        submitClose(i);
+                    } else {
+                        finishFile(i);
+                    }
+                    continue;
+                }
+                request.stage = FileStage::READ;
+                try {
+                    request.buffer.resize(request.file_statx.stx_size);
+                } catch (const std::exception&) {
+                    // The fallback in finishFile() reports the file as failed.
+                    request.failed = true;
+                    submitClose(i);
+                    continue;
+                }
+                if (request.buffer.empty()) {
+                    submitClose(i);
+                } else {
+                    submitRead(i);
+                }
+            } else if (request.stage == FileStage::READ) {
+                if (!request.failed && request.bytes_read < request.buffer.size()) {
+                    submitRead(i);
+                } else {
+                    submitClose(i);
+                }
+            } else if (request.stage == FileStage::CLOSE) {
+                finishFile(i);
+            }
+        }
+    }
+
+    if (ring_failed) {
+        // Reads still in flight write into the request buffers, so they are reaped before
+        // anything is freed. The files left unfinished are then loaded without the ring.
+        while (ring.inFlight() > 0) {
+            if (!ring.waitForCompletions(1)) {
+                for (const FileRequest& request : requests) {
+                    if (request.fd >= 0) {
+                        close(request.fd);
+                    }
+                }
+                // The kernel may still write into the buffers, so they are never released.
+                static_cast<void>(new std::vector<FileRequest>(std::move(requests)));
+                return false;
+            }
+            ring.forEachCompletion(recordCompletion);
+        }
+        for (size_t i = 0; i < requests.size(); ++i) {
+            FileRequest& request = requests[i];
+            if (request.stage == FileStage::DONE) {
+                continue;
+            }
+            if (request.fd >= 0) {
+                close(request.fd);
+                request.fd = -1;
+            }
+            request.failed = true;
+            finishFile(i);
+        }
+    }
+    return true;
+}
+
+#endif
+
+BatchLoadResult loadBMPBatch(
+    const std::vector<std::string>& filenames, size_t queue_depth, size_t threads) {
+    BatchLoadResult result;
+    result.images.resize(filenames.size());
+    result.loaded.assign(filenames.size(), 0);
+
+    auto start = std::chrono::steady_clock::now();
+
+#ifdef IMAGE_COMPRESSOR_HAS_IO_URING
+    result.used_io_uring = loadWithIoUring(filenames, queue_depth, result);
+#endif
+    if (!result.used_io_uring) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        loadWithThreadPool(filenames, threads, result);
+    }
+
+    result.elapsed_seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.failed_files = std::count(result.loaded.begin(), result.loaded.end(), 0);
+    result.files_per_second =
+        result.elapsed_seconds > 0 ? filenames.size() / result.elapsed_seconds : 0;
+
+    LOG_INFO("Пакетная загрузка BMP: ", filenames.size(), " файлов, ошибок: ", result.failed_files,
+             ", ", static_cast<uint64_t>(result.files_per_second), " файлов/с (",
+             result.used_io_uring ? "io_uring" : "pread", ").");
+    return result;
+}
@@ -0,0 +1,205 @@
+#include "buffer_pool.h"
+#include <bit>
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+
+// Set once the calling thread's cache is destroyed, so that buffers freed by later thread_local
+// destructors go straight to the depot.
+static thread_local bool thread_cache_destroyed = false;
+
+class ThreadBufferCache {
+public:
+    ~ThreadBufferCache() {
+        flush();
+        thread_cache_destroyed = true;
+    }
+
+    void* pop(size_t size_class) {
+        if (counts[size_class] == 0) {
+            return nullptr;
+        }
+        return blocks[size_class][--counts[size_class]];
+    }
+
+    bool push(void* block, size_t size_class) {
+        if (counts[size_class] == BufferPool::THREAD_CACHE_BLOCKS) {
+            return false;
+        }
+        blocks[size_class][counts[size_class]++] = block;
+        return true;
+    }
+
+    void flush() {
+        BufferPool& pool = BufferPool::instance();
+        for (size_t size_class = 0; size_class < BufferPool::SIZE_CLASS_COUNT; ++size_class) {
+            while (counts[size_class] > 0) {
+                void* block = blocks[size_class][--counts[size_class]];
+                pool.cached_bytes -= BufferPool::MIN_BLOCK_SIZE << size_class;
+                pool.release(block, size_class);
+            }
+        }
+    }
+
+private:
+    std::array<std::array<void*, BufferPool::THREAD_CACHE_BLOCKS>, BufferPool::SIZE_CLASS_COUNT>
+        blocks{};
+    std::array<uint8_t, BufferPool::SIZE_CLASS_COUNT> counts{};
+};
+
+static thread_local ThreadBufferCache thread_cache;
+
+BufferPool& BufferPool::instance() {
+    // Never destroyed: buffers may still be freed by other static and thread_local destructors.
+    static BufferPool* pool = new BufferPool();
+    return *pool;
+}
+
+size_t BufferPool::sizeClass(size_t bytes) {
+    if (bytes <= MIN_BLOCK_SIZE) {
+        return 0;
+    }
+    size_t size_class = std::bit_width(bytes - 1) - std::bit_width(MIN_BLOCK_SIZE - 1);
+    if (size_class >= SIZE_CLASS_COUNT) {
+        throw std::bad_alloc();
+    }
+    return size_class;
+}
+
+size_t BufferPool::blockSize(size_t bytes) {
+    return MIN_BLOCK_SIZE << sizeClass(bytes);
+}
+
+void* BufferPool::systemAllocate(size_t block_size) {
+    if (block_size < HUGE_PAGE_SIZE) {
+        void* block = std::aligned_alloc(MIN_BLOCK_SIZE, block_size);
+        if (block == nullptr) {
+            throw std::bad_alloc();
+        }
+        return block;
+    }
+
+#ifdef MAP_HUGETLB
+    if (huge_page_mode == HugePageMode::EXPLICIT) {
+        // Huge-page mappings are always aligned to the huge page size.
+        void* block = mmap(nullptr, block_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (block != MAP_FAILED) {
+            return block;
+        }
+    }
+#endif
+
+    // Over-map by one huge page and cut the ends off, so the block starts on a 2 MiB boundary.
+    size_t mapped_size = block_size + HUGE_PAGE_SIZE;
+    void* mapping = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                         -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    auto start = reinterpret_cast<uintptr_t>(mapping);
+    uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    if (aligned > start) {
+        munmap(mapping, aligned - start);
+    }
+    size_t tail = start + mapped_size - (aligned + block_size);
+    if (tail > 0) {
+        munmap(reinterpret_cast<void*>(aligned + block_size), tail);
+    }
+#ifdef MADV_HUGEPAGE
+    if (huge_page_mode != HugePageMode::NONE) {
+        madvise(reinterpret_cast<void*>(aligned), block_size, MADV_HUGEPAGE);
+    }
+#endif
+    return reinterpret_cast<void*>(aligned);
+}
+
+void BufferPool::systemFree(void* block, size_t block_size) {
+    if (block_size < HUGE_PAGE_SIZE) {
+        std::free(block);
+    } else {
+        munmap(block, block_size);
+    }
+}
+
+void* BufferPool::allocate(size_t bytes) {
+    size_t size_class = sizeClass(bytes);
+    size_t block_size = MIN_BLOCK_SIZE << size_class;
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    void* block = thread_cache_destroyed ? nullptr : thread_cache.pop(size_class);
+    if (block == nullptr) {
+        std::lock_guard<std::mutex> lock(depot_mutex);
+        if (!depot[size_class].empty()) {
+            block = depot[size_class].back();
+            depot[size_class].pop_back();
+        }
+    }
+    if (block != nullptr) {
+        cached_bytes -= block_size;
+        reused.fetch_add(1, std::memory_order_relaxed);
+        return block;
+    }
+
+    system_allocations.fetch_add(1, std::memory_order_relaxed);
+    return systemAllocate(block_size);
+}
+
+void BufferPool::deallocate(void* block, size_t bytes) {
+    if (block == nullptr) {
+        return;
+    }
+    size_t size_class = sizeClass(bytes);
+    size_t block_size = MIN_BLOCK_SIZE << size_class;
+    if (cached_bytes + block_size > max_cached_bytes) {
+        systemFree(block, block_size);
+        return;
+    }
+    if (!thread_cache_destroyed && thread_cache.push(block, size_class)) {
+        cached_bytes += block_size;
+        return;
+    }
+    release(block, size_class);
+}
+
+void BufferPool::release(void* block, size_t size_class) {
+    size_t block_size = MIN_BLOCK_SIZE << size_class;
+    if (cached_bytes + block_size > max_cached_bytes) {
+        systemFree(block, block_size);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(depot_mutex);
+    depot[size_class].push_back(block);
+    cached_bytes += block_size;
+}
+
+void BufferPool::setMaxCachedBytes(size_t bytes) {
+    max_cached_bytes = bytes;
+}
+
+void BufferPool::setHugePageMode(HugePageMode mode) {
+    huge_page_mode = mode;
+}
+
+void BufferPool::trim() {
+    if (!thread_cache_destroyed) {
+        thread_cache.flush();
+    }
+    std::lock_guard<std::mutex> lock(depot_mutex);
+    for (size_t size_class = 0; size_class < SIZE_CLASS_COUNT; ++size_class) {
+        for (void* block : depot[size_class]) {
+            systemFree(block, MIN_BLOCK_SIZE << size_class);
+            cached_bytes -= MIN_BLOCK_SIZE << size_class;
+        }
+        depot[size_class].clear();
+    }
+}
+
+BufferPoolStats BufferPool::stats() const {
+    BufferPoolStats result;
+    result.allocations = allocations.load(std::memory_order_relaxed);
+    result.reused = reused.load(std::memory_order_relaxed);
+    result.system_allocations = system_allocations.load(std::memory_order_relaxed);
+    result.cached_bytes = cached_bytes.load(std::memory_order_relaxed);
+    return result;
+}
@@ -2,15 +2,135 @@
 #include <iostream>
 #include <cmath>
 
-uint8_t colorToGrayscale(const ColorRGB& color) {
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Reference luma in double precision. Where 0.299r + 0.587g + 0.114b is exactly k + 0.5, the
+// direction of rounding depends on the representation error of the products, so those inputs keep
+// this expression.
+static uint8_t roundedLuma(const ColorRGB& color) {
     double grayValue = 0.299 * static_cast<double>(color.r) +
                        0.587 * static_cast<double>(color.g) +
                        0.114 * static_cast<double>(color.b);
     return static_cast<uint8_t>(std::round(grayValue));
-   
 }
 
-ColorRGB readFromFileStream(std::fstream& stream) {
+// 1000 * luma + 500, exact in integers.
+static uint32_t shiftedLuma1000(const ColorRGB& color) {
+    return 299u * color.r + 587u * color.g + 114u * color.b + 500u;
+}
+
+uint8_t colorToGrayscale(const ColorRGB& color) {
+    uint32_t luma = shiftedLuma1000(color);
+    if (luma % 1000 == 0) {
+        return roundedLuma(color);
+    }
+    return static_cast<uint8_t>(luma / 1000);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 1000 * luma + 500 of the four pixels starting at byte `first` of block.
+__attribute__((target("ssse3")))
+static inline __m128i shiftedLuma1000x4(__m128i block, int first) {
+    const __m128i rg_weights = _mm_set1_epi32((587 << 16) | 299);
+    const __m128i b_weights = _mm_set1_epi32(114);
+    const char z = static_cast<char>(0x80);
+    const char f = static_cast<char>(first);
+    __m128i rg = _mm_shuffle_epi8(block, _mm_setr_epi8(f, z, f + 1, z, f + 3, z, f + 4, z,
+                                                       f + 6, z, f + 7, z, f + 9, z, f + 10, z));
+    __m128i b = _mm_shuffle_epi8(block, _mm_setr_epi8(f + 2, z, z, z, f + 5, z, z, z,
+                                                      f + 8, z, z, z, f + 11, z, z, z));
+    __m128i luma = _mm_add_epi32(_mm_madd_epi16(rg, rg_weights), _mm_madd_epi16(b, b_weights));
+    return _mm_add_epi32(luma, _mm_set1_epi32(500));
+}
+
+// Divides eight shifted lumas by 1000 and marks the lanes that are exact halves.
+__attribute__((target("ssse3")))
+static inline __m128i lumaQuotient(__m128i low, __m128i high, __m128i& halves) {
+    // x / 1000 == (x / 8) / 125, and x / 8 < 2^15 fits the 16-bit multiply-high.
+    __m128i eighths = _mm_packs_epi32(_mm_srli_epi32(low, 3), _mm_srli_epi32(high, 3));
+    __m128i remainders = _mm_packs_epi32(_mm_and_si128(low, _mm_set1_epi32(7)),
+                                         _mm_and_si128(high, _mm_set1_epi32(7)));
+    __m128i quotient = _mm_srli_epi16(_mm_mulhi_epu16(eighths, _mm_set1_epi16(33555)), 6);
+    halves = _mm_and_si128(
+        _mm_cmpeq_epi16(_mm_mullo_epi16(quotient, _mm_set1_epi16(125)), eighths),
+        _mm_cmpeq_epi16(remainders, _mm_setzero_si128()));
+    return quotient;
+}
+
+__attribute__((target("ssse3")))
+static size_t toGrayscaleRowSSSE3(const ColorRGB* colors, uint8_t* gray, size_t count) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(colors);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const uint8_t* block = bytes + 3 * i;
+        __m128i luma0 = shiftedLuma1000x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block)), 0);
+        __m128i luma1 = shiftedLuma1000x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 12)), 0);
+        __m128i luma2 = shiftedLuma1000x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 24)), 0);
+        // The last four pixels end the 48-byte block; load its final 16 bytes to stay inside it.
+        __m128i luma3 = shiftedLuma1000x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 32)), 4);
+
+        __m128i halves_low, halves_high;
+        __m128i low = lumaQuotient(luma0, luma1, halves_low);
+        __m128i high = lumaQuotient(luma2, luma3, halves_high);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + i), _mm_packus_epi16(low, high));
+
+        int halves = _mm_movemask_epi8(_mm_packs_epi16(halves_low, halves_high));
+        while (halves != 0) {
+            int lane = __builtin_ctz(halves);
+            gray[i + lane] = roundedLuma(colors[i + lane]);
+            halves &= halves - 1;
+        }
+    }
+    return i;
+}
+#endif
+
+void toGrayscaleRow(const ColorRGB* colors, uint8_t* gray, size_t count) {
+    size_t i = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("ssse3")) {
+        i = toGrayscaleRowSSSE3(colors, gray, count);
+    }
+#endif
+    for (; i < count; ++i) {
+        gray[i] = colorToGrayscale(colors[i]);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("ssse3")))
+static size_t grayToColorRowSSSE3(const uint8_t* gray, ColorRGB* colors, size_t count) {
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(colors);
+    const __m128i spread0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+    const __m128i spread1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+    const __m128i spread2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(gray + i));
+        uint8_t* block = bytes + 3 * i;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(block), _mm_shuffle_epi8(values, spread0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(block + 16), _mm_shuffle_epi8(values, spread1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(block + 32), _mm_shuffle_epi8(values, spread2));
+    }
+    return i;
+}
+#endif
+
+void grayToColorRow(const uint8_t* gray, ColorRGB* colors, size_t count) {
+    size_t i = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("ssse3")) {
+        i = grayToColorRowSSSE3(gray, colors, count);
+    }
+#endif
+    for (; i < count; ++i) {
+        colors[i] = ColorRGB{gray[i], gray[i], gray[i]};
+    }
+}
+
+ColorRGB readFromFileStream(std::istream& stream) {
     ColorRGB color;
     stream.read(reinterpret_cast<char*>(&color.r), sizeof(uint8_t));
     stream.read(reinterpret_cast<char*>(&color.g), sizeof(uint8_t));
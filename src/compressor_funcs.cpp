@@ -2,9 +2,14 @@
 #include "error_handlers.h"
 #include "libbmp.h"
 #include "images.h"
+#include "metrics.h"
+#include "palette_lut.h"
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <limits>
 #include <iostream>
+#include <unordered_map>
 /*
 * Implement all the functions declared in the header file here.
 * Use the BMP class from libbmp.h to save and load BMP files.
@@ -12,68 +17,80 @@
 * These function will read, write, convert and compress images across different formats.
 */
 
-void saveAsBMP(const UncompressedImage& img, const std::string& filename) {
-    BMP bmp(img.getWidth(), img.getHeight());
-
-    for (uint32_t y = 0; y < img.getHeight(); ++y) {
-        for (uint32_t x = 0; x < img.getWidth(); ++x) {
-            Pixel pixel = img.getPixel(x, y);
-            if (img.isGrayscale()) {
-                uint8_t gray = colorToGrayscale(pixel);
-                bmp.set_pixel(x, y, gray, gray, gray);
-            } else {
-                bmp.set_pixel(x, y, pixel.r, pixel.g, pixel.b);
+bool saveAsBMP(const UncompressedImage& img, const std::string& filename) {
+    uint64_t pixel_count = static_cast<uint64_t>(img.getWidth()) * img.getHeight();
+    STAGE_TIMER(timer, "saveAsBMP", pixel_count, pixel_count * 3);
+    try {
+        BMP bmp(img.getWidth(), img.getHeight());
+        for (uint32_t y = 0; y < img.getHeight(); ++y) {
+            if (img.hasGrayStorage()) {
+                std::span<const uint8_t> row = img.getGrayData()[y];
+                for (uint32_t x = 0; x < img.getWidth(); ++x) {
+                    bmp.set_pixel(x, y, row[x], row[x], row[x]);
+                }
+                continue;
+            }
+            std::span<const ColorRGB> row = img.getImageData()[y];
+            for (uint32_t x = 0; x < img.getWidth(); ++x) {
+                if (img.getIsGrayscale()) {
+                    uint8_t gray = colorToGrayscale(row[x]);
+                    bmp.set_pixel(x, y, gray, gray, gray);
+                } else {
+                    bmp.set_pixel(x, y, row[x].r, row[x].g, row[x].b);
+                }
             }
         }
+        bmp.write(filename.c_str());
+    } catch (const std::exception& e) {
+        std::cerr << "Не удалось сохранить BMP файл: " << filename << " (" << e.what() << ")" << std::endl;
+        return false;
     }
-
-    if (!bmp.write(filename.c_str())) {
-        std::cerr << "Не удалось сохранить BMP файл: " << filename << std::endl;
-    }
+    return true;
 }
 
 UncompressedImage loadFromBMP(const std::string& filename) {
-    BMP bmp;
-    if (!bmp.read(filename.c_str())) {
-        std::cerr << "Не удалось загрузить BMP файл: " << filename << std::endl;
-        return UncompressedImage(); 
-    }
-
-    UncompressedImage img;
-    img.setWidth(bmp.get_width());
-    img.setHeight(bmp.get_height());
-    img.setGrayscale(false);
-
-    std::vector<Pixel> pixels;
-    pixels.reserve(img.getWidth() * img.getHeight());
-
-    for (uint32_t y = 0; y < img.getHeight(); ++y) {
-        for (uint32_t x = 0; x < img.getWidth(); ++x) {
-            uint8_t r, g, b;
-            bmp.get_pixel(x, y, r, g, b);
-            pixels.emplace_back(Pixel{r, g, b});
+    STAGE_TIMER(timer, "loadFromBMP");
+    try {
+        BMP bmp(filename.c_str());
+        // Rows are filled in place in the image created with its final size.
+        UncompressedImage img(bmp.get_width(), bmp.get_height());
+        for (uint32_t y = 0; y < img.getHeight(); ++y) {
+            std::span<ColorRGB> row = img.getMutableRow(y);
+            for (uint32_t x = 0; x < img.getWidth(); ++x) {
+                bmp.get_pixel(x, y, row[x].r, row[x].g, row[x].b);
+            }
         }
+        uint64_t pixel_count = static_cast<uint64_t>(img.getWidth()) * img.getHeight();
+        timer.setWork(pixel_count, pixel_count * 3);
+        return img;
+    } catch (const std::exception& e) {
+        std::cerr << "Не удалось загрузить BMP файл: " << filename << " (" << e.what() << ")" << std::endl;
+        return UncompressedImage();
     }
-
-    img.setPixels(pixels);
-
-    return img;
-    return {};
 }
 
-UncompressedImage readUncompressedFile(const std::string& filename) {
+UncompressedImage readUncompressedFile(const std::string& filename, bool compact_grayscale) {
+    STAGE_TIMER(timer, "readUncompressedFile");
     UncompressedImage img;
-    if (!img.readFromFile(filename)) {
+    if (!img.readFromFile(filename, compact_grayscale)) {
         std::cerr << "Не удалось прочитать UncompressedImage файл: " << filename << std::endl;
     }
+    uint64_t pixel_count = static_cast<uint64_t>(img.getWidth()) * img.getHeight();
+    timer.setWork(pixel_count, pixel_count * (img.hasGrayStorage() ? 1 : 3));
     return img;
     return {};
 }
 
-void writeUncompressedFile(const std::string& filename, const UncompressedImage& image) {
-    if (!image.writeToFile(filename)) {
+bool writeUncompressedFile(
+    const std::string& filename, const UncompressedImage& image, bool delta_coding) {
+    uint64_t pixel_count = static_cast<uint64_t>(image.getWidth()) * image.getHeight();
+    STAGE_TIMER(timer, "writeUncompressedFile", pixel_count,
+                pixel_count * (image.hasGrayStorage() ? 1 : 3));
+    if (!image.writeToFile(filename, delta_coding)) {
         std::cerr << "Не удалось записать UncompressedImage файл: " << filename << std::endl;
+        return false;
     }
+    return true;
 }
 
 uint8_t findClosestColorId(const ColorRGB& color, const std::map<uint8_t, ColorRGB>& colorTable) {
@@ -98,75 +115,244 @@ uint8_t findClosestColorId(const ColorRGB& color, const std::map<uint8_t, ColorR
 CompressedImage toCompressed(
     const UncompressedImage& img, const std::map<uint8_t, ColorRGB>& color_table, bool approximate,
     bool allow_color_add) {
-
-    CompressedImage cImg;
-    cImg.setWidth(img.getWidth());
-    cImg.setHeight(img.getHeight());
-    cImg.setGrayscale(img.isGrayscale());
+    uint64_t pixel_count = static_cast<uint64_t>(img.getWidth()) * img.getHeight();
+    static StageMetrics& exact_stage = MetricsRegistry::instance().stage("toCompressed");
+    static StageMetrics& approximate_stage =
+        MetricsRegistry::instance().stage("toCompressed(approximate)");
+    ScopedTimer timer(approximate ? approximate_stage : exact_stage, pixel_count, pixel_count * 3);
+
+    uint32_t width = img.getWidth();
+    uint32_t height = img.getHeight();
+    auto colorAt = [&img](uint32_t x, uint32_t y) {
+        if (img.hasGrayStorage()) {
+            uint8_t gray = img.getGrayData()[y][x];
+            return ColorRGB{gray, gray, gray};
+        }
+        return img.getImageData()[y][x];
+    };
 
     std::map<uint8_t, ColorRGB> table = color_table;
+    std::unordered_map<ColorRGB, uint8_t, ColorHash> color_to_id;
+    for (const auto& [id, color] : table) {
+        color_to_id.emplace(color, id);
+    }
 
     if (table.empty()) {
-        table = std::map<uint8_t, ColorRGB>();
-        uint8_t currentId = 0;
-        for (const auto& pixel : img.getPixels()) {
-            bool exists = false;
-            for (const auto& [id, tableColor] : table) {
-                if (tableColor == pixel) {
-                    exists = true;
-                    break;
+        bool table_full = false;
+        for (uint32_t y = 0; y < height && !table_full; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                ColorRGB color = colorAt(x, y);
+                if (color_to_id.count(color) != 0) {
+                    continue;
                 }
-            }
-            if (!exists) {
-                if (currentId >= 256) {
+                if (table.size() == 256) {
                     std::cerr << "Таблица цветов переполнена. Максимум 256 цветов.\n";
+                    table_full = true;
                     break;
                 }
-                table[currentId++] = pixel;
+                uint8_t id = table.size();
+                table[id] = color;
+                color_to_id[color] = id;
             }
         }
     }
 
-    cImg.setColorTable(table);
+    // Approximate conversions with a fixed palette look every pixel up in the shared
+    // nearest-color table once enough pixels have been converted with that palette.
+    std::shared_ptr<const PaletteLUT> lut;
+    if (approximate && !color_table.empty()) {
+        lut = PaletteLUT::acquire(color_table, pixel_count);
+    }
 
-    std::vector<uint8_t> pixelIds;
-    pixelIds.reserve(img.getWidth() * img.getHeight());
+    // Rows are written in place and the tables are moved in, so nothing is copied.
+    CompressedImage cImg(width, height);
+    for (uint32_t y = 0; y < height; ++y) {
+        std::span<uint8_t> row = cImg.getMutableRow(y);
+        for (uint32_t x = 0; x < width; ++x) {
+            ColorRGB color = colorAt(x, y);
+            if (lut) {
+                row[x] = lut->lookup(color);
+                continue;
+            }
+            auto found = color_to_id.find(color);
+            row[x] = found != color_to_id.end() ? found->second : findClosestColorId(color, table);
+        }
+    }
+    cImg.setIdToColor(std::move(table));
+    cImg.setColorToId(std::move(color_to_id));
+    return cImg;
+}
 
-    for (const auto& pixel : img.getPixels()) {
-        uint8_t id = findClosestColorId(pixel, table);
-        pixelIds.push_back(id);
+UncompressedImage toUncompressed(const CompressedImage& img) {
+    uint64_t pixel_count = static_cast<uint64_t>(img.getWidth()) * img.getHeight();
+    STAGE_TIMER(timer, "toUncompressed", pixel_count, pixel_count);
+    const auto& colorTable = img.getIdToColor();
+    ColorRGB colors[256] = {};
+    bool known[256] = {};
+    for (const auto& [id, color] : colorTable) {
+        colors[id] = color;
+        known[id] = true;
     }
 
-    cImg.setPixelIds(pixelIds);
+    UncompressedImage uImg(img.getWidth(), img.getHeight());
+    for (uint32_t y = 0; y < img.getHeight(); ++y) {
+        std::span<const uint8_t> ids = img.getImageData()[y];
+        std::span<ColorRGB> row = uImg.getMutableRow(y);
+        for (uint32_t x = 0; x < img.getWidth(); ++x) {
+            if (!known[ids[x]]) {
+                std::cerr << "ID цвета " << static_cast<int>(ids[x]) << " не найден в цветовой таблице.\n";
+            }
+            row[x] = colors[ids[x]];
+        }
+    }
 
-    return cImg;
+    return uImg;
 }
 
-UncompressedImage toUncompressed(const CompressedImage& img) {
-    UncompressedImage uImg;
-    uImg.setWidth(img.getWidth());
-    uImg.setHeight(img.getHeight());
-    uImg.setGrayscale(img.isGrayscale());
-
-    const auto& colorTable = img.getColorTable();
-    const auto& pixelIds = img.getPixelIds();
-
-    std::vector<Pixel> pixels;
-    pixels.reserve(pixelIds.size());
-
-    for (const auto& id : pixelIds) {
-        auto it = colorTable.find(id);
-        if (it != colorTable.end()) {
-            pixels.emplace_back(Pixel{it->second.r, it->second.g, it->second.b});
-        } else {
-            std::cerr << "ID цвета " << static_cast<int>(id) << " не найден в цветовой таблице.\n";
-            pixels.emplace_back(Pixel{0, 0, 0}); 
+static constexpr char COMPRESSED_SIGNATURE[10] = "CMPRIMAGE";
+// Ten bytes without the terminating zero.
+static constexpr char COMPRESSED_END_SIGNATURE[11] = "CMPRIMGEND";
+static constexpr char PYRAMID_SIGNATURE[10] = "CMPRLEVEL";
+static constexpr char PYRAMID_END_SIGNATURE[10] = "LEVELSEND";
+static constexpr size_t PYRAMID_ENTRY_SIZE = 4 + 4 + 8;
+
+// Box-filters 2x2 blocks of the previous level and maps the averaged color back to the palette.
+static ImagePlane<uint8_t> downsampleIdRows(
+    const ImagePlane<uint8_t>& rows, uint32_t width, uint32_t height,
+    const std::map<uint8_t, ColorRGB>& colorTable, uint32_t& new_width, uint32_t& new_height) {
+    new_width = std::max<uint32_t>(1, (width + 1) / 2);
+    new_height = std::max<uint32_t>(1, (height + 1) / 2);
+
+    std::vector<ColorRGB> palette(256, ColorRGB{0, 0, 0});
+    for (const auto& [id, color] : colorTable) {
+        palette[id] = color;
+    }
+
+    std::unordered_map<ColorRGB, uint8_t, ColorHash> closest_cache;
+    ImagePlane<uint8_t> downsampled(new_width, new_height);
+
+    for (uint32_t y = 0; y < new_height; ++y) {
+        for (uint32_t x = 0; x < new_width; ++x) {
+            uint32_t sum_r = 0, sum_g = 0, sum_b = 0, count = 0;
+            for (uint32_t dy = 0; dy < 2 && 2 * y + dy < height; ++dy) {
+                for (uint32_t dx = 0; dx < 2 && 2 * x + dx < width; ++dx) {
+                    const ColorRGB& color = palette[rows[2 * y + dy][2 * x + dx]];
+                    sum_r += color.r;
+                    sum_g += color.g;
+                    sum_b += color.b;
+                    ++count;
+                }
+            }
+
+            ColorRGB average{
+                static_cast<uint8_t>((sum_r + count / 2) / count),
+                static_cast<uint8_t>((sum_g + count / 2) / count),
+                static_cast<uint8_t>((sum_b + count / 2) / count)};
+            auto it = closest_cache.find(average);
+            if (it == closest_cache.end()) {
+                it = closest_cache.emplace(average, findClosestColorId(average, colorTable)).first;
+            }
+            downsampled[y][x] = it->second;
         }
     }
 
-    uImg.setPixels(pixels);
+    return downsampled;
+}
 
-    return uImg;
+static void writePyramidLevels(
+    std::ofstream& outfile, const CompressedImage& image, uint8_t pyramid_levels) {
+    std::vector<ImagePlane<uint8_t>> levels;
+    std::vector<std::pair<uint32_t, uint32_t>> sizes;
+
+    const ImagePlane<uint8_t>* previous = &image.getImageData();
+    uint32_t level_width = image.getWidth();
+    uint32_t level_height = image.getHeight();
+    while (levels.size() < pyramid_levels && (level_width > 1 || level_height > 1)) {
+        uint32_t new_width, new_height;
+        levels.push_back(downsampleIdRows(
+            *previous, level_width, level_height, image.getIdToColor(), new_width, new_height));
+        sizes.emplace_back(new_width, new_height);
+        previous = &levels.back();
+        level_width = new_width;
+        level_height = new_height;
+    }
+
+    uint64_t section_offset = static_cast<uint64_t>(outfile.tellp());
+    outfile.write(PYRAMID_SIGNATURE, 10);
+
+    uint8_t levels_count = static_cast<uint8_t>(levels.size());
+    outfile.write(reinterpret_cast<const char*>(&levels_count), 1);
+
+    uint64_t level_offset = section_offset + 10 + 1 + levels.size() * PYRAMID_ENTRY_SIZE;
+    for (size_t i = 0; i < levels.size(); ++i) {
+        outfile.write(reinterpret_cast<const char*>(&sizes[i].first), 4);
+        outfile.write(reinterpret_cast<const char*>(&sizes[i].second), 4);
+        outfile.write(reinterpret_cast<const char*>(&level_offset), 8);
+        level_offset += static_cast<uint64_t>(sizes[i].first) * sizes[i].second;
+    }
+
+    for (const auto& level : levels) {
+        outfile.write(reinterpret_cast<const char*>(level.data()), level.pixelCount());
+    }
+
+    outfile.write(reinterpret_cast<const char*>(&section_offset), sizeof(section_offset));
+    outfile.write(PYRAMID_END_SIGNATURE, 10);
+}
+
+// Reads the signature, version, size and palette that start every CMPRIMAGE file.
+static bool readCompressedHeader(
+    std::istream& infile, const std::string& filename, uint32_t& width, uint32_t& height,
+    std::map<uint8_t, ColorRGB>& colorTable) {
+    char format[10];
+    infile.read(format, 10);
+    if (!infile || std::memcmp(format, COMPRESSED_SIGNATURE, 10) != 0) {
+        std::cerr << "Неверный формат CompressedImage файла: " << filename << std::endl;
+        return false;
+    }
+
+    unsigned char version[3];
+    infile.read(reinterpret_cast<char*>(version), 3);
+    if (!infile || version[0] != 6 || version[1] != 6 || version[2] != 6) {
+        std::cerr << "Неверная версия CompressedImage файла: " << filename << std::endl;
+        return false;
+    }
+
+    infile.read(reinterpret_cast<char*>(&width), 4);
+    infile.read(reinterpret_cast<char*>(&height), 4);
+
+    unsigned char pow;
+    infile.read(reinterpret_cast<char*>(&pow), 1);
+    if (!infile || pow > 8) {
+        std::cerr << "Некорректная таблица цветов в CompressedImage файле: " << filename << std::endl;
+        return false;
+    }
+    size_t colorTableSize = size_t{1} << pow;
+    for (size_t i = 0; i < colorTableSize; ++i) {
+        colorTable[static_cast<uint8_t>(i)] = readFromFileStream(infile);
+    }
+    return !infile.fail();
+}
+
+// Reverse of a palette read by position; a color listed twice maps to its smallest id.
+static std::unordered_map<ColorRGB, uint8_t, ColorHash> buildColorToId(
+    const std::map<uint8_t, ColorRGB>& colorTable) {
+    std::unordered_map<ColorRGB, uint8_t, ColorHash> color_to_id;
+    for (const auto& [id, color] : colorTable) {
+        color_to_id.emplace(color, id);
+    }
+    return color_to_id;
+}
+
+// Fills the rows of an image created with its final size straight from the stream.
+static bool readIdRows(std::istream& infile, CompressedImage& cImg) {
+    for (uint32_t y = 0; y < cImg.getHeight(); ++y) {
+        std::span<uint8_t> row = cImg.getMutableRow(y);
+        infile.read(reinterpret_cast<char*>(row.data()), row.size());
+        if (infile.gcount() != static_cast<std::streamsize>(row.size())) {
+            return false;
+        }
+    }
+    return true;
 }
 
 ColorRGB getColor(const CompressedImage& img, int x, int y) {
@@ -175,16 +361,14 @@ ColorRGB getColor(const CompressedImage& img, int x, int y) {
         return ColorRGB{0, 0, 0}; 
     }
 
-    uint32_t index = y * img.getWidth() + x;
-    const auto& pixelIds = img.getPixelIds();
-
-    if (index >= pixelIds.size()) {
-        std::cerr << "Индекс пикселя " << index << " выходит за пределы массива пикселей.\n";
+    const auto& rows = img.getImageData();
+    if (static_cast<uint32_t>(y) >= rows.size() || static_cast<uint32_t>(x) >= rows[y].size()) {
+        std::cerr << "Пиксель (" << x << ", " << y << ") отсутствует в данных изображения.\n";
         return ColorRGB{0, 0, 0};
     }
 
-    uint8_t id = pixelIds[index];
-    const auto& colorTable = img.getColorTable();
+    uint8_t id = rows[y][x];
+    const auto& colorTable = img.getIdToColor();
     auto it = colorTable.find(id);
     if (it != colorTable.end()) {
         return it->second;
@@ -195,73 +379,50 @@ ColorRGB getColor(const CompressedImage& img, int x, int y) {
 }
 
 CompressedImage readCompressedFile(const std::string& filename) {
-    CompressedImage cImg;
+    STAGE_TIMER(timer, "readCompressedFile");
     std::ifstream infile(filename, std::ios::binary);
     if (!infile) {
         std::cerr << "Не удалось открыть CompressedImage файл для чтения: " << filename << std::endl;
-        return cImg; 
-    }
-
-    char format[10];
-    infile.read(format, 10);
-    if (std::string(format, 10) != "CMPRIMAGE\0") {
-        std::cerr << "Неверный формат CompressedImage файла: " << filename << std::endl;
-        return cImg;
-    }
-
-    unsigned char version[3];
-    infile.read(reinterpret_cast<char*>(version), 3);
-    if (version[0] != 6 || version[1] != 6 || version[2] != 6) {
-        std::cerr << "Неверная версия CompressedImage файла: " << filename << std::endl;
-        return cImg;
+        return CompressedImage();
     }
 
     uint32_t width, height;
-    infile.read(reinterpret_cast<char*>(&width), 4);
-    infile.read(reinterpret_cast<char*>(&height), 4);
-    cImg.setWidth(width);
-    cImg.setHeight(height);
-    cImg.setGrayscale(false); 
-
-    unsigned char pow;
-    infile.read(reinterpret_cast<char*>(&pow), 1);
-    size_t colorTableSize = std::pow(2, pow);
     std::map<uint8_t, ColorRGB> colorTable;
-
-    for (size_t i = 0; i < colorTableSize; ++i) {
-        ColorRGB color = readFromFileStream(infile);
-        colorTable[i] = color;
+    if (!readCompressedHeader(infile, filename, width, height, colorTable)) {
+        return CompressedImage();
     }
 
-    cImg.setColorTable(colorTable);
-
-    std::vector<uint8_t> pixelIds(width * height);
-    infile.read(reinterpret_cast<char*>(pixelIds.data()), width * height);
-    if (infile.gcount() != static_cast<std::streamsize>(width * height)) {
+    // Rows are read in place and the palette is moved in, so nothing is copied.
+    CompressedImage cImg(width, height);
+    if (!readIdRows(infile, cImg)) {
         std::cerr << "Некорректный размер пикселей в CompressedImage файле: " << filename << std::endl;
-        return cImg;
+        return CompressedImage();
     }
-    cImg.setPixelIds(pixelIds);
+    uint64_t pixel_count = static_cast<uint64_t>(width) * height;
+    timer.setWork(pixel_count, pixel_count);
 
     char end[10];
     infile.read(end, 10);
-    if (std::string(end, 10) != "CMPRIMGEND\0") {
+    if (!infile || std::memcmp(end, COMPRESSED_END_SIGNATURE, 10) != 0) {
         std::cerr << "Отсутствует завершающая подпись в CompressedImage файле: " << filename << std::endl;
     }
 
-    infile.close();
+    cImg.setColorToId(buildColorToId(colorTable));
+    cImg.setIdToColor(std::move(colorTable));
     return cImg;
 }
 
-void writeCompressedFile(const std::string& filename, const CompressedImage& image) {
+bool writeCompressedFile(
+    const std::string& filename, const CompressedImage& image, uint8_t pyramid_levels) {
+    uint64_t pixel_count = static_cast<uint64_t>(image.getWidth()) * image.getHeight();
+    STAGE_TIMER(timer, "writeCompressedFile", pixel_count, pixel_count);
     std::ofstream outfile(filename, std::ios::binary);
     if (!outfile) {
         std::cerr << "Не удалось открыть CompressedImage файл для записи: " << filename << std::endl;
-        return;
+        return false;
     }
 
-    char format[10] = "CMPRIMAGE\0";
-    outfile.write(format, 10);
+    outfile.write(COMPRESSED_SIGNATURE, 10);
 
     unsigned char version[3] = {6, 6, 6};
     outfile.write(reinterpret_cast<char*>(version), 3);
@@ -271,10 +432,10 @@ void writeCompressedFile(const std::string& filename, const CompressedImage& ima
     outfile.write(reinterpret_cast<const char*>(&width), 4);
     outfile.write(reinterpret_cast<const char*>(&height), 4);
 
-    const auto& colorTable = image.getColorTable();
+    const auto& colorTable = image.getIdToColor();
     size_t colorTableSize = colorTable.size();
     unsigned char pow = 0;
-    while (std::pow(2, pow) < colorTableSize) {
+    while ((size_t{1} << pow) < colorTableSize) {
         pow++;
     }
     outfile.write(reinterpret_cast<char*>(&pow), 1);
@@ -284,12 +445,95 @@ void writeCompressedFile(const std::string& filename, const CompressedImage& ima
         outfile.write(reinterpret_cast<const char*>(&color.g), 1);
         outfile.write(reinterpret_cast<const char*>(&color.b), 1);
     }
+    // Readers take 2^pow colors by position, so a shorter palette is padded with black.
+    const char padding[3] = {0, 0, 0};
+    for (size_t i = colorTableSize; i < (size_t{1} << pow); ++i) {
+        outfile.write(padding, 3);
+    }
 
-    const auto& pixelIds = image.getPixelIds();
-    outfile.write(reinterpret_cast<const char*>(pixelIds.data()), pixelIds.size());
+    outfile.write(reinterpret_cast<const char*>(image.getImageData().data()), image.getImageData().pixelCount());
 
-    char end[10] = "CMPRIMGEND\0";
-    outfile.write(end, 10);
+    outfile.write(COMPRESSED_END_SIGNATURE, 10);
+
+    if (pyramid_levels > 0) {
+        writePyramidLevels(outfile, image, pyramid_levels);
+    }
 
     outfile.close();
+    if (!outfile) {
+        std::cerr << "Не удалось записать CompressedImage файл: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+CompressedImage readLevel(const std::string& filename, uint8_t level) {
+    STAGE_TIMER(timer, "readLevel");
+    if (level == 0) {
+        return readCompressedFile(filename);
+    }
+
+    std::ifstream infile(filename, std::ios::binary);
+    if (!infile) {
+        std::cerr << "Не удалось открыть CompressedImage файл для чтения: " << filename << std::endl;
+        return CompressedImage();
+    }
+
+    uint32_t width, height;
+    std::map<uint8_t, ColorRGB> colorTable;
+    if (!readCompressedHeader(infile, filename, width, height, colorTable)) {
+        return CompressedImage();
+    }
+
+    uint64_t section_offset = 0;
+    char levels_end[10];
+    infile.seekg(-static_cast<std::streamoff>(sizeof(section_offset) + 10), std::ios::end);
+    infile.read(reinterpret_cast<char*>(&section_offset), sizeof(section_offset));
+    infile.read(levels_end, 10);
+    if (!infile || std::memcmp(levels_end, PYRAMID_END_SIGNATURE, 10) != 0) {
+        std::cerr << "CompressedImage файл не содержит уровней пирамиды: " << filename << std::endl;
+        return CompressedImage();
+    }
+
+    char levels_format[10];
+    infile.seekg(static_cast<std::streamoff>(section_offset), std::ios::beg);
+    infile.read(levels_format, 10);
+    if (!infile || std::memcmp(levels_format, PYRAMID_SIGNATURE, 10) != 0) {
+        std::cerr << "Повреждена таблица уровней пирамиды в файле: " << filename << std::endl;
+        return CompressedImage();
+    }
+
+    uint8_t levels_count;
+    infile.read(reinterpret_cast<char*>(&levels_count), 1);
+    if (level > levels_count) {
+        std::cerr << "Уровень " << static_cast<int>(level) << " отсутствует в файле " << filename
+                  << " (доступно уровней: " << static_cast<int>(levels_count) << ")" << std::endl;
+        return CompressedImage();
+    }
+
+    uint32_t level_width, level_height;
+    uint64_t level_offset;
+    infile.seekg(static_cast<std::streamoff>(level - 1) * PYRAMID_ENTRY_SIZE, std::ios::cur);
+    infile.read(reinterpret_cast<char*>(&level_width), 4);
+    infile.read(reinterpret_cast<char*>(&level_height), 4);
+    infile.read(reinterpret_cast<char*>(&level_offset), 8);
+    // A level is never larger than the image it was built from.
+    if (!infile || level_width > width || level_height > height) {
+        std::cerr << "Повреждена таблица уровней пирамиды в файле: " << filename << std::endl;
+        return CompressedImage();
+    }
+
+    CompressedImage cImg(level_width, level_height);
+    infile.seekg(static_cast<std::streamoff>(level_offset), std::ios::beg);
+    if (!readIdRows(infile, cImg)) {
+        std::cerr << "Некорректный размер уровня " << static_cast<int>(level)
+                  << " в CompressedImage файле: " << filename << std::endl;
+        return CompressedImage();
+    }
+    timer.setWork(static_cast<uint64_t>(level_width) * level_height,
+                  static_cast<uint64_t>(level_width) * level_height);
+
+    cImg.setColorToId(buildColorToId(colorTable));
+    cImg.setIdToColor(std::move(colorTable));
+    return cImg;
 }
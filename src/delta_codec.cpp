@@ -0,0 +1,565 @@
+#include "delta_codec.h"
+#include "error_handlers.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstring>
+#include <queue>
+
+static constexpr uint32_t MAX_CODE_LENGTH = 12;
+static constexpr uint32_t DECODE_TABLE_SIZE = 1u << MAX_CODE_LENGTH;
+static constexpr size_t STREAM_PADDING = 16;
+static constexpr size_t STREAM_COUNT = 4;
+
+struct DeltaPlane {
+    uint8_t bit_depth = 8;
+    ImagePlane<uint16_t> samples;
+};
+
+// MED predictor from LOCO-I: the median of left, up and left + up - up_left.
+static inline uint16_t predictMED(int32_t left, int32_t up, int32_t up_left) {
+    return static_cast<uint16_t>(
+        std::max(std::min(left, up), std::min(std::max(left, up), left + up - up_left)));
+}
+
+static inline uint16_t predictAt(const uint16_t* plane, uint32_t x, uint32_t y, uint32_t width) {
+    if (y == 0) {
+        return x == 0 ? 0 : plane[x - 1];
+    }
+    const uint16_t* row = plane + static_cast<size_t>(y) * width;
+    const uint16_t* prev_row = row - width;
+    if (x == 0) {
+        return prev_row[0];
+    }
+    return predictMED(row[x - 1], prev_row[x], prev_row[x - 1]);
+}
+
+static inline uint16_t foldResidual(uint16_t value, uint16_t prediction, uint8_t bit_depth) {
+    int32_t modulus = 1 << bit_depth;
+    int32_t residual = (static_cast<int32_t>(value) - prediction) & (modulus - 1);
+    if (residual >= modulus / 2) {
+        residual -= modulus;
+    }
+    return static_cast<uint16_t>(residual >= 0 ? 2 * residual : -2 * residual - 1);
+}
+
+static std::vector<uint8_t> buildCodeLengths(const std::vector<uint64_t>& frequencies) {
+    size_t alphabet_size = frequencies.size();
+    std::vector<uint8_t> lengths(alphabet_size, 0);
+    std::vector<uint64_t> weights = frequencies;
+
+    size_t used_symbols = std::count_if(weights.begin(), weights.end(), [](uint64_t w) {
+        return w > 0;
+    });
+    if (used_symbols == 0) {
+        return lengths;
+    }
+    if (used_symbols == 1) {
+        lengths[std::find_if(weights.begin(), weights.end(), [](uint64_t w) { return w > 0; })
+                - weights.begin()] = 1;
+        return lengths;
+    }
+
+    while (true) {
+        using Node = std::pair<uint64_t, int32_t>;
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+        std::vector<int32_t> parent(2 * alphabet_size, -1);
+        int32_t next_node = static_cast<int32_t>(alphabet_size);
+
+        for (size_t symbol = 0; symbol < alphabet_size; ++symbol) {
+            if (weights[symbol] > 0) {
+                queue.emplace(weights[symbol], static_cast<int32_t>(symbol));
+            }
+        }
+        while (queue.size() > 1) {
+            auto [weight_a, node_a] = queue.top();
+            queue.pop();
+            auto [weight_b, node_b] = queue.top();
+            queue.pop();
+            parent[node_a] = next_node;
+            parent[node_b] = next_node;
+            queue.emplace(weight_a + weight_b, next_node++);
+        }
+
+        uint32_t max_length = 0;
+        for (size_t symbol = 0; symbol < alphabet_size; ++symbol) {
+            if (weights[symbol] == 0) {
+                continue;
+            }
+            uint32_t length = 0;
+            for (int32_t node = static_cast<int32_t>(symbol); parent[node] != -1;
+                 node = parent[node]) {
+                ++length;
+            }
+            lengths[symbol] = static_cast<uint8_t>(length);
+            max_length = std::max(max_length, length);
+        }
+
+        if (max_length <= MAX_CODE_LENGTH) {
+            return lengths;
+        }
+        for (auto& weight : weights) {
+            if (weight > 0) {
+                weight = (weight + 1) / 2;
+            }
+        }
+    }
+}
+
+// Canonical codes, stored bit-reversed so that the decoder can index its table with the low bits.
+static std::vector<uint16_t> buildCanonicalCodes(const std::vector<uint8_t>& lengths) {
+    std::vector<uint16_t> codes(lengths.size(), 0);
+    uint32_t length_count[MAX_CODE_LENGTH + 1] = {0};
+    for (uint8_t length : lengths) {
+        ++length_count[length];
+    }
+    length_count[0] = 0;
+
+    uint32_t next_code[MAX_CODE_LENGTH + 2] = {0};
+    uint32_t code = 0;
+    for (uint32_t length = 1; length <= MAX_CODE_LENGTH; ++length) {
+        code = (code + length_count[length - 1]) << 1;
+        next_code[length] = code;
+    }
+
+    for (size_t symbol = 0; symbol < lengths.size(); ++symbol) {
+        uint8_t length = lengths[symbol];
+        if (length == 0) {
+            continue;
+        }
+        uint32_t canonical = next_code[length]++;
+        uint32_t reversed = 0;
+        for (uint8_t bit = 0; bit < length; ++bit) {
+            reversed |= ((canonical >> bit) & 1) << (length - 1 - bit);
+        }
+        codes[symbol] = static_cast<uint16_t>(reversed);
+    }
+    return codes;
+}
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& output) : output(output) {}
+
+    void write(uint32_t bits, uint32_t count) {
+        buffer |= static_cast<uint64_t>(bits) << bit_count;
+        bit_count += count;
+        while (bit_count >= 8) {
+            output.push_back(static_cast<uint8_t>(buffer));
+            buffer >>= 8;
+            bit_count -= 8;
+        }
+    }
+
+    void finish() {
+        if (bit_count > 0) {
+            output.push_back(static_cast<uint8_t>(buffer));
+        }
+        output.insert(output.end(), STREAM_PADDING, 0);
+        buffer = 0;
+        bit_count = 0;
+    }
+
+private:
+    std::vector<uint8_t>& output;
+    uint64_t buffer = 0;
+    uint32_t bit_count = 0;
+};
+
+static void appendPlane(std::vector<uint8_t>& payload, const DeltaPlane& plane, uint32_t width,
+                        uint32_t height) {
+    size_t alphabet_size = size_t{1} << plane.bit_depth;
+    const uint16_t* samples = plane.samples.data();
+    std::vector<uint16_t> symbols(plane.samples.pixelCount());
+    std::vector<uint64_t> frequencies(alphabet_size, 0);
+
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            size_t index = static_cast<size_t>(y) * width + x;
+            uint16_t prediction = predictAt(samples, x, y, width);
+            symbols[index] = foldResidual(samples[index], prediction, plane.bit_depth);
+            ++frequencies[symbols[index]];
+        }
+    }
+
+    std::vector<uint8_t> lengths = buildCodeLengths(frequencies);
+    std::vector<uint16_t> codes = buildCanonicalCodes(lengths);
+
+    payload.push_back(plane.bit_depth);
+    payload.insert(payload.end(), lengths.begin(), lengths.end());
+
+    // Independent streams over consecutive sample ranges let the decoder overlap their bit chains.
+    std::vector<uint8_t> streams[STREAM_COUNT];
+    for (size_t k = 0; k < STREAM_COUNT; ++k) {
+        size_t begin = symbols.size() * k / STREAM_COUNT;
+        size_t end = symbols.size() * (k + 1) / STREAM_COUNT;
+        streams[k].reserve((end - begin) / 2 + STREAM_PADDING);
+        BitWriter writer(streams[k]);
+        for (size_t i = begin; i < end; ++i) {
+            writer.write(codes[symbols[i]], lengths[symbols[i]]);
+        }
+        writer.finish();
+    }
+
+    for (const auto& stream : streams) {
+        uint64_t stream_size = stream.size();
+        const uint8_t* size_bytes = reinterpret_cast<const uint8_t*>(&stream_size);
+        payload.insert(payload.end(), size_bytes, size_bytes + sizeof(stream_size));
+    }
+    for (const auto& stream : streams) {
+        payload.insert(payload.end(), stream.begin(), stream.end());
+    }
+}
+
+struct BitReader {
+    const uint8_t* stream = nullptr;
+    const uint8_t* stream_limit = nullptr;
+    uint64_t buffer = 0;
+    uint32_t bit_count = 0;
+
+    // Refills without a branch on the bit count: the 8 bytes at stream are always readable, since
+    // every stream ends with STREAM_PADDING zero bytes.
+    bool decode(const uint32_t* table, uint16_t& value) {
+        if (stream > stream_limit) {
+            return false;
+        }
+        uint64_t chunk;
+        std::memcpy(&chunk, stream, sizeof(chunk));
+        buffer |= chunk << bit_count;
+        stream += (63 - bit_count) >> 3;
+        bit_count |= 56;
+
+        uint32_t entry = table[buffer & (DECODE_TABLE_SIZE - 1)];
+        uint32_t length = entry & 0xFF;
+        buffer >>= length;
+        bit_count -= length;
+        value = static_cast<uint16_t>(entry >> 8);
+        return length != 0;
+    }
+};
+
+// Branch-free min and max: MED picks among noisy neighbours unpredictably, and the compiler
+// turns std::min/std::max of this chain into branches.
+static inline int32_t minOf(int32_t a, int32_t b) {
+    int32_t difference = a - b;
+    return b + (difference & (difference >> 31));
+}
+
+static inline int32_t maxOf(int32_t a, int32_t b) {
+    int32_t difference = a - b;
+    return a - (difference & (difference >> 31));
+}
+
+// Adds the MED prediction to the residual at x of a row, given the row above.
+static inline void reconstructMED(
+    uint16_t* row, const uint16_t* prev_row, uint32_t x, int32_t& left, int32_t& up_left,
+    int32_t mask) {
+    int32_t up = prev_row[x];
+    int32_t gradient = up - up_left + left;
+    int32_t prediction = maxOf(minOf(left, up), minOf(maxOf(left, up), gradient));
+    left = (prediction + row[x]) & mask;
+    row[x] = static_cast<uint16_t>(left);
+    up_left = up;
+}
+
+static constexpr uint32_t MED_ROW_GROUP = 4;
+
+// Reconstructs up to MED_ROW_GROUP rows below the first as a wavefront: each row runs one column
+// behind the row above, which is all it needs, so the serial chains of the rows overlap.
+static void reconstructMEDRows(ImagePlane<uint16_t>& samples, uint32_t first, uint32_t count, int32_t mask) {
+    uint32_t width = static_cast<uint32_t>(samples.rowLength());
+    uint16_t* rows[MED_ROW_GROUP];
+    int32_t left[MED_ROW_GROUP];
+    int32_t up_left[MED_ROW_GROUP];
+    for (uint32_t g = 0; g < count; ++g) {
+        rows[g] = samples[first + g].data();
+        up_left[g] = rows[g][-static_cast<ptrdiff_t>(width)];
+        left[g] = (up_left[g] + rows[g][0]) & mask;
+        rows[g][0] = static_cast<uint16_t>(left[g]);
+    }
+    if (count < MED_ROW_GROUP || width <= MED_ROW_GROUP) {
+        for (uint32_t g = 0; g < count; ++g) {
+            for (uint32_t x = 1; x < width; ++x) {
+                reconstructMED(rows[g], rows[g] - width, x, left[g], up_left[g], mask);
+            }
+        }
+        return;
+    }
+
+    // Step t handles column t - g of row g.
+    for (uint32_t t = 1; t < MED_ROW_GROUP; ++t) {
+        for (uint32_t g = 0; g < t; ++g) {
+            reconstructMED(rows[g], rows[g] - width, t - g, left[g], up_left[g], mask);
+        }
+    }
+    for (uint32_t t = MED_ROW_GROUP; t < width; ++t) {
+        for (uint32_t g = 0; g < MED_ROW_GROUP; ++g) {
+            reconstructMED(rows[g], rows[g] - width, t - g, left[g], up_left[g], mask);
+        }
+    }
+    for (uint32_t t = width; t < width + MED_ROW_GROUP - 1; ++t) {
+        for (uint32_t g = t - width + 1; g < MED_ROW_GROUP; ++g) {
+            reconstructMED(rows[g], rows[g] - width, t - g, left[g], up_left[g], mask);
+        }
+    }
+}
+
+// Everything of a plane's header that decoding needs. Parsing is cheap and sequential; the
+// samples of separate planes are then decoded in parallel.
+struct PlaneDecoder {
+    uint8_t bit_depth = 8;
+    // Indexed by the next MAX_CODE_LENGTH bits of a stream: the unfolded residual modulo
+    // 2^bit_depth in bits 8 and up, the code length in the low byte, 0 for an invalid code.
+    std::vector<uint32_t> table;
+    BitReader readers[STREAM_COUNT];
+};
+
+// Every code is at least one bit long, so a stream of n bytes holds at most 8 * (n - padding)
+// samples: a header whose width and height need more is rejected before samples are allocated.
+static bool readPlaneHeader(
+    const std::vector<uint8_t>& payload, size_t& position, uint32_t width, uint32_t height,
+    uint8_t expected_depth, PlaneDecoder& plane) {
+    if (position + 1 > payload.size() || payload[position] != expected_depth) {
+        return false;
+    }
+    plane.bit_depth = payload[position++];
+    size_t alphabet_size = size_t{1} << plane.bit_depth;
+    if (position + alphabet_size + sizeof(uint64_t) > payload.size()) {
+        return false;
+    }
+
+    std::vector<uint8_t> lengths(payload.begin() + position,
+                                 payload.begin() + position + alphabet_size);
+    position += alphabet_size;
+    if (std::any_of(lengths.begin(), lengths.end(), [](uint8_t l) { return l > MAX_CODE_LENGTH; })) {
+        return false;
+    }
+
+    uint64_t stream_sizes[STREAM_COUNT];
+    if (position + sizeof(stream_sizes) > payload.size()) {
+        return false;
+    }
+    std::memcpy(stream_sizes, payload.data() + position, sizeof(stream_sizes));
+    position += sizeof(stream_sizes);
+    size_t sample_count = static_cast<size_t>(width) * height;
+    for (size_t k = 0; k < STREAM_COUNT; ++k) {
+        if (stream_sizes[k] < STREAM_PADDING || stream_sizes[k] > payload.size() - position) {
+            return false;
+        }
+        size_t segment_size = sample_count * (k + 1) / STREAM_COUNT - sample_count * k / STREAM_COUNT;
+        if (segment_size > 8 * (stream_sizes[k] - STREAM_PADDING)) {
+            return false;
+        }
+        plane.readers[k].stream = payload.data() + position;
+        plane.readers[k].stream_limit = plane.readers[k].stream + stream_sizes[k] - sizeof(uint64_t);
+        position += stream_sizes[k];
+    }
+
+    std::vector<uint16_t> codes = buildCanonicalCodes(lengths);
+    uint32_t mask = (1u << plane.bit_depth) - 1;
+    plane.table.assign(DECODE_TABLE_SIZE, 0);
+    for (size_t symbol = 0; symbol < alphabet_size; ++symbol) {
+        if (lengths[symbol] == 0) {
+            continue;
+        }
+        int32_t residual = static_cast<int32_t>(symbol >> 1) ^ -static_cast<int32_t>(symbol & 1);
+        uint32_t entry = ((static_cast<uint32_t>(residual) & mask) << 8) | lengths[symbol];
+        for (uint32_t fill = codes[symbol]; fill < DECODE_TABLE_SIZE;
+             fill += 1u << lengths[symbol]) {
+            plane.table[fill] = entry;
+        }
+    }
+    return true;
+}
+
+// Decodes the residuals of the four streams in lockstep, so that their independent bit chains
+// overlap, then adds the MED prediction back.
+static bool decodePlane(
+    PlaneDecoder& plane, uint32_t width, uint32_t height, ImagePlane<uint16_t>& samples) {
+    samples = ImagePlane<uint16_t>(width, height);
+    size_t sample_count = samples.pixelCount();
+    const uint32_t* table = plane.table.data();
+
+    uint16_t* segments[STREAM_COUNT];
+    size_t segment_sizes[STREAM_COUNT];
+    for (size_t k = 0; k < STREAM_COUNT; ++k) {
+        size_t begin = sample_count * k / STREAM_COUNT;
+        segments[k] = samples.data() + begin;
+        segment_sizes[k] = sample_count * (k + 1) / STREAM_COUNT - begin;
+    }
+
+    static_assert(STREAM_COUNT == 4);
+    BitReader reader_0 = plane.readers[0];
+    BitReader reader_1 = plane.readers[1];
+    BitReader reader_2 = plane.readers[2];
+    BitReader reader_3 = plane.readers[3];
+    size_t common_size = *std::min_element(segment_sizes, segment_sizes + STREAM_COUNT);
+    for (size_t i = 0; i < common_size; ++i) {
+        bool valid = reader_0.decode(table, segments[0][i]);
+        valid &= reader_1.decode(table, segments[1][i]);
+        valid &= reader_2.decode(table, segments[2][i]);
+        valid &= reader_3.decode(table, segments[3][i]);
+        if (!valid) {
+            return false;
+        }
+    }
+    BitReader* readers[STREAM_COUNT] = {&reader_0, &reader_1, &reader_2, &reader_3};
+    for (size_t k = 0; k < STREAM_COUNT; ++k) {
+        for (size_t i = common_size; i < segment_sizes[k]; ++i) {
+            if (!readers[k]->decode(table, segments[k][i])) {
+                return false;
+            }
+        }
+    }
+
+    int32_t mask = (1 << plane.bit_depth) - 1;
+    if (width == 0 || height == 0) {
+        return true;
+    }
+    uint16_t* first_row = samples[0].data();
+    int32_t left = 0;
+    for (uint32_t x = 0; x < width; ++x) {
+        left = (left + first_row[x]) & mask;
+        first_row[x] = static_cast<uint16_t>(left);
+    }
+    for (uint32_t y = 1; y < height; y += MED_ROW_GROUP) {
+        reconstructMEDRows(samples, y, std::min(MED_ROW_GROUP, height - y), mask);
+    }
+    return true;
+}
+
+// Rows of at least this many samples in total are worth a thread of their own when converting
+// decoded planes to pixels.
+static constexpr size_t MIN_PARALLEL_SAMPLES = 1 << 16;
+
+std::vector<uint8_t> encodeDeltaImage(
+    const ImagePlane<ColorRGB>& pixels, uint32_t width, uint32_t height,
+    bool is_grayscale, bool color_transform) {
+    std::vector<uint8_t> payload;
+
+    if (is_grayscale) {
+        DeltaPlane gray{8, ImagePlane<uint16_t>(width, height)};
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                gray.samples[y][x] = pixels[y][x].r;
+            }
+        }
+        appendPlane(payload, gray, width, height);
+        return payload;
+    }
+
+    uint8_t chroma_depth = color_transform ? 9 : 8;
+    DeltaPlane planes[3] = {
+        {8, ImagePlane<uint16_t>(width, height)},
+        {chroma_depth, ImagePlane<uint16_t>(width, height)},
+        {chroma_depth, ImagePlane<uint16_t>(width, height)}};
+
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            const ColorRGB& color = pixels[y][x];
+            if (color_transform) {
+                int32_t co = static_cast<int32_t>(color.r) - color.b;
+                int32_t t = color.b + (co >> 1);
+                int32_t cg = static_cast<int32_t>(color.g) - t;
+                planes[0].samples[y][x] = static_cast<uint16_t>(t + (cg >> 1));
+                planes[1].samples[y][x] = static_cast<uint16_t>(co & 0x1FF);
+                planes[2].samples[y][x] = static_cast<uint16_t>(cg & 0x1FF);
+            } else {
+                planes[0].samples[y][x] = color.r;
+                planes[1].samples[y][x] = color.g;
+                planes[2].samples[y][x] = color.b;
+            }
+        }
+    }
+
+    for (const auto& plane : planes) {
+        appendPlane(payload, plane, width, height);
+    }
+    return payload;
+}
+
+bool decodeDeltaImage(
+    const std::vector<uint8_t>& payload, uint32_t width, uint32_t height, bool is_grayscale,
+    bool color_transform, ImagePlane<ColorRGB>& pixels) {
+    size_t position = 0;
+    size_t plane_count = is_grayscale ? 1 : 3;
+    uint8_t chroma_depth = color_transform ? 9 : 8;
+    PlaneDecoder decoders[3];
+    for (size_t p = 0; p < plane_count; ++p) {
+        if (!readPlaneHeader(payload, position, width, height, p == 0 ? 8 : chroma_depth, decoders[p])) {
+            handleLogMessage("Повреждённые данные дельта-кодирования.", Severity::ERROR);
+            return false;
+        }
+    }
+
+    ImagePlane<uint16_t> planes[3];
+    bool decoded[3] = {false, false, false};
+    parallelForBands(plane_count, 1, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; ++p) {
+            decoded[p] = decodePlane(decoders[p], width, height, planes[p]);
+        }
+    });
+    if (!std::all_of(decoded, decoded + plane_count, [](bool ok) { return ok; })) {
+        handleLogMessage("Повреждённые данные дельта-кодирования.", Severity::ERROR);
+        return false;
+    }
+
+    pixels = ImagePlane<ColorRGB>(width, height);
+    size_t min_rows = std::max<size_t>(1, MIN_PARALLEL_SAMPLES / std::max<uint32_t>(width, 1));
+    parallelForBands(height, min_rows, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            ColorRGB* row = pixels[y].data();
+            const uint16_t* plane_0 = planes[0][y].data();
+            if (is_grayscale) {
+                for (uint32_t x = 0; x < width; ++x) {
+                    uint8_t value = static_cast<uint8_t>(plane_0[x]);
+                    row[x] = ColorRGB{value, value, value};
+                }
+                continue;
+            }
+            const uint16_t* plane_1 = planes[1][y].data();
+            const uint16_t* plane_2 = planes[2][y].data();
+            for (uint32_t x = 0; x < width; ++x) {
+                if (color_transform) {
+                    int32_t co = static_cast<int32_t>(plane_1[x] ^ 0x100) - 0x100;
+                    int32_t cg = static_cast<int32_t>(plane_2[x] ^ 0x100) - 0x100;
+                    int32_t t = static_cast<int32_t>(plane_0[x]) - (cg >> 1);
+                    int32_t g = cg + t;
+                    int32_t b = t - (co >> 1);
+                    int32_t r = b + co;
+                    row[x] = ColorRGB{
+                        static_cast<uint8_t>(r), static_cast<uint8_t>(g), static_cast<uint8_t>(b)};
+                } else {
+                    row[x] = ColorRGB{
+                        static_cast<uint8_t>(plane_0[x]), static_cast<uint8_t>(plane_1[x]),
+                        static_cast<uint8_t>(plane_2[x])};
+                }
+            }
+        }
+    });
+    return true;
+}
+
+std::vector<uint8_t> encodeDeltaGrayImage(
+    const ImagePlane<uint8_t>& gray, uint32_t width, uint32_t height) {
+    DeltaPlane plane{8, ImagePlane<uint16_t>(width, height)};
+    std::copy(gray.pixels().begin(), gray.pixels().end(), plane.samples.data());
+    std::vector<uint8_t> payload;
+    appendPlane(payload, plane, width, height);
+    return payload;
+}
+
+bool decodeDeltaGrayImage(
+    const std::vector<uint8_t>& payload, uint32_t width, uint32_t height,
+    ImagePlane<uint8_t>& gray) {
+    size_t position = 0;
+    PlaneDecoder decoder;
+    ImagePlane<uint16_t> samples;
+    if (!readPlaneHeader(payload, position, width, height, 8, decoder)
+        || !decodePlane(decoder, width, height, samples)) {
+        handleLogMessage("Повреждённые данные дельта-кодирования.", Severity::ERROR);
+        return false;
+    }
+    gray = ImagePlane<uint8_t>(width, height);
+    std::copy(samples.pixels().begin(), samples.pixels().end(), gray.data());
+    return true;
+}
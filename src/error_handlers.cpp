@@ -1,62 +1,358 @@
 #include "error_handlers.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <utility>
 
-struct GlobalLogFile {
-    std::fstream file;
-    bool verbose = false;
+static constexpr size_t LOG_RECORD_TEXT_SIZE = 500;
 
-    void close() {
-        if (file.is_open()) {
-            file.close();
+static std::string_view severityTag(Severity severity) {
+    switch (severity) {
+        case Severity::INFO:
+            return "[INFO]";
+        case Severity::WARNING:
+            return "[WARNING]";
+        case Severity::ERROR:
+            return "[ERROR]";
+        case Severity::CRITICAL:
+            return "[CRITICAL]";
+    }
+    return "";
+}
+
+struct alignas(64) LogRecord {
+    std::atomic<size_t> sequence;
+    uint32_t length;
+    char text[LOG_RECORD_TEXT_SIZE];
+};
+
+// Bounded multi-producer queue of preformatted lines (Vyukov's ring). Producers only claim a slot
+// and copy the text; a single background thread concatenates everything that is ready and writes
+// it to the log file with one write per batch.
+class AsyncLogQueue {
+public:
+    AsyncLogQueue(
+        size_t capacity, LogOverflowPolicy policy, std::function<void(std::string_view)> sink)
+        : policy(policy), sink(std::move(sink)) {
+        size_t slots = 2;
+        while (slots < capacity) {
+            slots *= 2;
+        }
+        mask = slots - 1;
+        records = std::make_unique<LogRecord[]>(slots);
+        for (size_t i = 0; i < slots; ++i) {
+            records[i].sequence.store(i, std::memory_order_relaxed);
         }
+        consumer = std::thread([this] { drain(); });
     }
 
-    void open(const std::string& filename, bool verbose) {
-        file.open(filename, std::ios::out);
-        if (!file.is_open()) {
-            throw std::runtime_error("Cannot open log file");
+    ~AsyncLogQueue() {
+        stopping.store(true, std::memory_order_release);
+        consumer.join();
+    }
+
+    void push(std::string_view line) {
+        while (!tryPush(line)) {
+            if (policy == LogOverflowPolicy::DROP) {
+                dropped_records.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            std::this_thread::yield();
         }
-        this->verbose = verbose;
     }
-} global_log_file;
 
-void openLogFile(const std::string& filename, bool verbose) {
-    global_log_file.open(filename, verbose);
+    void flush() {
+        size_t target = enqueue_pos.load(std::memory_order_acquire);
+        while (written_records.load(std::memory_order_acquire) < target) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    size_t dropped() const { return dropped_records.load(std::memory_order_relaxed); }
+
+private:
+    bool tryPush(std::string_view line) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            LogRecord& record = records[pos & mask];
+            size_t sequence = record.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence - pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    fill(record, line);
+                    record.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    static void fill(LogRecord& record, std::string_view line) {
+        size_t length = line.size();
+        if (length > LOG_RECORD_TEXT_SIZE) {
+            // Keep the line break and never cut a UTF-8 sequence in half.
+            length = LOG_RECORD_TEXT_SIZE - 1;
+            while (length > 0 && (static_cast<uint8_t>(line[length]) & 0xC0) == 0x80) {
+                --length;
+            }
+            std::memcpy(record.text, line.data(), length);
+            record.text[length++] = '\n';
+        } else {
+            std::memcpy(record.text, line.data(), length);
+        }
+        record.length = length;
+    }
+
+    void drain() {
+        std::string batch;
+        size_t dequeue_pos = 0;
+        while (true) {
+            batch.clear();
+            size_t count = 0;
+            while (count <= mask) {
+                LogRecord& record = records[dequeue_pos & mask];
+                if (record.sequence.load(std::memory_order_acquire) != dequeue_pos + 1) {
+                    break;
+                }
+                batch.append(record.text, record.length);
+                record.sequence.store(dequeue_pos + mask + 1, std::memory_order_release);
+                ++dequeue_pos;
+                ++count;
+            }
+
+            if (count > 0) {
+                sink(batch);
+                written_records.fetch_add(count, std::memory_order_release);
+            } else if (stopping.load(std::memory_order_acquire)) {
+                break;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    LogOverflowPolicy policy;
+    std::function<void(std::string_view)> sink;
+    size_t mask = 0;
+    std::unique_ptr<LogRecord[]> records;
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> written_records{0};
+    std::atomic<size_t> dropped_records{0};
+    std::atomic<bool> stopping{false};
+    std::thread consumer;
+};
+
+static constexpr size_t THREAD_BUFFER_LIMIT = 16 * 1024;
+
+static std::atomic<uint64_t> next_logger_id{0};
+static thread_local LogContext current_log_context;
+
+struct ThreadLogBuffer {
+    std::mutex mutex;
+    Logger* owner = nullptr;
+    std::string text;
+
+    void flushLocked() {
+        if (owner != nullptr && !text.empty()) {
+            owner->writeToFile(text);
+        }
+        text.clear();
+    }
+};
+
+// Owned by each thread; hands whatever is still buffered to its logger when the thread exits.
+struct ThreadLogBuffers {
+    std::vector<std::pair<uint64_t, std::shared_ptr<ThreadLogBuffer>>> buffers;
+
+    ~ThreadLogBuffers() {
+        for (auto& [logger_id, buffer] : buffers) {
+            std::lock_guard<std::mutex> lock(buffer->mutex);
+            buffer->flushLocked();
+            buffer->owner = nullptr;
+        }
+    }
+};
+
+static thread_local ThreadLogBuffers thread_log_buffers;
+
+static void formatRecord(std::string& out, const std::string& message, Severity severity) {
+    out += severityTag(severity);
+    if (!current_log_context.job_id.empty()) {
+        out += " [job=";
+        out += current_log_context.job_id;
+        out += ']';
+    }
+    if (!current_log_context.image_name.empty()) {
+        out += " [image=";
+        out += current_log_context.image_name;
+        out += ']';
+    }
+    out += ": ";
+    out += message;
+    out += '\n';
 }
 
-void closeLogFile() { global_log_file.close(); }
+ScopedLogContext::ScopedLogContext(LogContext context)
+    : previous(std::exchange(current_log_context, std::move(context))) {
+}
 
-void handleLogMessage(
-    const std::string& message, Severity severity, int exit_code, std::fstream& output) {
-    switch (severity) {
-        case Severity::INFO:
-            output << "[INFO]: ";
-            break;
-        case Severity::WARNING:
-            output << "[WARNING]: ";
-            break;
-        case Severity::ERROR:
-            output << "[ERROR]: ";
-            break;
-        case Severity::CRITICAL:
-            output << "[CRITICAL]: ";
-            break;
+ScopedLogContext::~ScopedLogContext() { current_log_context = std::move(previous); }
+
+Logger::Logger() : id(next_logger_id++) {}
+
+Logger::~Logger() {
+    disableAsync();
+    flushThreadBuffers();
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    for (auto& buffer : buffers) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        buffer->owner = nullptr;
     }
+}
+
+void Logger::open(const std::string& filename, bool verbose) {
+    flush();
+    std::lock_guard<std::mutex> lock(file_mutex);
+    file.open(filename, std::ios::out);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open log file");
+    }
+    this->verbose.store(verbose, std::memory_order_relaxed);
+}
+
+void Logger::close() {
+    flush();
+    std::lock_guard<std::mutex> lock(file_mutex);
+    if (file.is_open()) {
+        file.close();
+    }
+}
 
-    output << message << std::endl;
+void Logger::flush() {
+    if (async_queue) {
+        async_queue->flush();
+    }
+    flushThreadBuffers();
+}
+
+bool Logger::isEnabled(Severity severity) const {
+    return severity >= Severity::ERROR || verbose.load(std::memory_order_relaxed);
+}
+
+void Logger::log(const std::string& message, Severity severity, int exit_code) {
+    if (!isEnabled(severity)) {
+        return;
+    }
 
     if (severity == Severity::CRITICAL) {
+        flush();
+        std::string line;
+        formatRecord(line, message, severity);
+        writeToFile(line);
         exit(exit_code);
     }
+
+    if (async_queue) {
+        static thread_local std::string line;
+        line.clear();
+        formatRecord(line, message, severity);
+        async_queue->push(line);
+        return;
+    }
+
+    ThreadLogBuffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    formatRecord(buffer.text, message, severity);
+    if (severity >= Severity::ERROR || buffer.text.size() >= THREAD_BUFFER_LIMIT) {
+        buffer.flushLocked();
+    }
 }
 
-void handleLogMessage(const std::string& message, Severity severity, int exit_code) {
-    if (global_log_file.verbose || severity == Severity::CRITICAL || severity == Severity::ERROR) {
-        handleLogMessage(message, severity, exit_code, global_log_file.file);
+void Logger::enableAsync(size_t capacity, LogOverflowPolicy policy) {
+    disableAsync();
+    flushThreadBuffers();
+    async_queue = std::make_unique<AsyncLogQueue>(
+        capacity, policy, [this](std::string_view batch) { writeToFile(batch); });
+}
+
+void Logger::disableAsync() { async_queue.reset(); }
+
+size_t Logger::droppedMessages() const { return async_queue ? async_queue->dropped() : 0; }
+
+ThreadLogBuffer& Logger::threadBuffer() {
+    for (auto& [logger_id, buffer] : thread_log_buffers.buffers) {
+        if (logger_id == id) {
+            return *buffer;
+        }
+    }
+
+    auto buffer = std::make_shared<ThreadLogBuffer>();
+    buffer->owner = this;
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        // Buffers of threads that have already exited are only referenced from here.
+        std::erase_if(buffers, [](const auto& other) { return other.use_count() == 1; });
+        buffers.push_back(buffer);
     }
+    thread_log_buffers.buffers.emplace_back(id, buffer);
+    return *buffer;
 }
 
-void handleLogMessage(const std::string& message) {
-    if (global_log_file.verbose) {
-        handleLogMessage(message, Severity::INFO, 0, global_log_file.file);
+void Logger::flushThreadBuffers() {
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    for (auto& buffer : buffers) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        buffer->flushLocked();
     }
 }
+
+void Logger::writeToFile(std::string_view data) {
+    std::lock_guard<std::mutex> lock(file_mutex);
+    if (file.is_open()) {
+        file.write(data.data(), data.size());
+        file.flush();
+    }
+}
+
+Logger& globalLogger() {
+    static Logger logger;
+    return logger;
+}
+
+void openLogFile(const std::string& filename, bool verbose) {
+    globalLogger().open(filename, verbose);
+}
+
+void closeLogFile() { globalLogger().close(); }
+
+void enableAsyncLogging(size_t capacity, LogOverflowPolicy policy) {
+    globalLogger().enableAsync(capacity, policy);
+}
+
+void disableAsyncLogging() { globalLogger().disableAsync(); }
+
+size_t droppedLogMessages() { return globalLogger().droppedMessages(); }
+
+void handleLogMessage(
+    const std::string& message, Severity severity, int exit_code, std::fstream& output) {
+    output << severityTag(severity) << ": " << message << std::endl;
+
+    if (severity == Severity::CRITICAL) {
+        exit(exit_code);
+    }
+}
+
+void handleLogMessage(const std::string& message, Severity severity, int exit_code) {
+    globalLogger().log(message, severity, exit_code);
+}
+
+void handleLogMessage(const std::string& message) { globalLogger().log(message, Severity::INFO); }
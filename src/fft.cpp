@@ -0,0 +1,72 @@
+#include "fft.h"
+#include "buffer_pool.h"
+#include <bit>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+// exp(-2 pi i k / n) for k < n / 2, cached per thread for every size used.
+static const std::vector<std::complex<double>>& twiddles(size_t n) {
+    thread_local std::vector<std::vector<std::complex<double>>> tables(64);
+    std::vector<std::complex<double>>& table = tables[std::bit_width(n)];
+    if (table.empty()) {
+        table.resize(n / 2);
+        for (size_t k = 0; k < n / 2; ++k) {
+            table[k] = std::polar(1.0, -2 * M_PI * static_cast<double>(k) / static_cast<double>(n));
+        }
+    }
+    return table;
+}
+
+void fft(std::complex<double>* data, size_t n, bool inverse) {
+    if (n < 2) {
+        return;
+    }
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(data[i], data[j]);
+        }
+    }
+
+    const std::vector<std::complex<double>>& table = twiddles(n);
+    double sign = inverse ? -1 : 1;
+    for (size_t length = 2; length <= n; length <<= 1) {
+        size_t half = length / 2;
+        size_t step = n / length;
+        for (size_t start = 0; start < n; start += length) {
+            for (size_t k = 0; k < half; ++k) {
+                // Written out: std::complex multiplication goes through the NaN-checking
+                // __muldc3 unless the build uses -ffast-math.
+                double w_re = table[k * step].real();
+                double w_im = sign * table[k * step].imag();
+                std::complex<double> even = data[start + k];
+                std::complex<double> odd = data[start + k + half];
+                double odd_re = odd.real() * w_re - odd.imag() * w_im;
+                double odd_im = odd.real() * w_im + odd.imag() * w_re;
+                data[start + k] = {even.real() + odd_re, even.imag() + odd_im};
+                data[start + k + half] = {even.real() - odd_re, even.imag() - odd_im};
+            }
+        }
+    }
+}
+
+void fft2D(std::complex<double>* data, size_t rows, size_t columns, bool inverse) {
+    for (size_t y = 0; y < rows; ++y) {
+        fft(data + y * columns, columns, inverse);
+    }
+    PooledVector<std::complex<double>> column(rows);
+    for (size_t x = 0; x < columns; ++x) {
+        for (size_t y = 0; y < rows; ++y) {
+            column[y] = data[y * columns + x];
+        }
+        fft(column.data(), rows, inverse);
+        for (size_t y = 0; y < rows; ++y) {
+            data[y * columns + x] = column[y];
+        }
+    }
+}
@@ -0,0 +1,179 @@
+#include "image_row_writer.h"
+#include "error_handlers.h"
+#include "libbmp.h"
+#include <cstring>
+
+uint64_t ImageRowWriter::bmpFileSize(uint32_t width, uint32_t height) {
+    uint64_t padded_row = (static_cast<uint64_t>(width) * 3 + 3) / 4 * 4;
+    return sizeof(BMPHeader) + sizeof(BMPInfoHeader) + padded_row * height;
+}
+
+bool ImageRowWriter::open(const std::string& name, Format new_format, uint32_t w, uint32_t h) {
+    out.close();
+    out.clear();
+    filename = name;
+    format = new_format;
+    width = w;
+    height = h;
+    rows_written = 0;
+    failed = false;
+    if (width == 0 || height == 0) {
+        return fail("Размеры изображения должны быть положительными: " + filename);
+    }
+    out.open(filename, std::ios::binary);
+    if (!out) {
+        return fail("Не удалось открыть файл для записи: " + filename);
+    }
+    return true;
+}
+
+bool ImageRowWriter::openBMP(const std::string& name, uint32_t w, uint32_t h) {
+    uint64_t file_size = bmpFileSize(w, h);
+    if (file_size > MAX_BMP_FILE_SIZE) {
+        filename = name;
+        return fail("Изображение слишком велико для BMP (4 ГиБ и больше): " + name);
+    }
+    if (!open(name, Format::BMP, w, h)) {
+        return false;
+    }
+
+    BMPHeader file_header;
+    file_header.file_size = file_size;
+    file_header.offset_data = sizeof(BMPHeader) + sizeof(BMPInfoHeader);
+    BMPInfoHeader info_header;
+    info_header.size = sizeof(BMPInfoHeader);
+    info_header.width = static_cast<int32_t>(width);
+    // A negative height stores rows top-down, in the order they are written.
+    info_header.height = -static_cast<int32_t>(height);
+    info_header.bit_count = 24;
+    info_header.compression = 0;
+    out.write(reinterpret_cast<const char*>(&file_header), sizeof(file_header));
+    out.write(reinterpret_cast<const char*>(&info_header), sizeof(info_header));
+    // Padding bytes at the end of every row stay zero.
+    bytes.assign((static_cast<size_t>(width) * 3 + 3) / 4 * 4, 0);
+    return out.good() || fail("Ошибка записи в файл: " + filename);
+}
+
+bool ImageRowWriter::openRaw(const std::string& name, uint32_t w, uint32_t h, bool gray) {
+    if (!open(name, Format::RAWIMAGE, w, h)) {
+        return false;
+    }
+    is_grayscale = gray;
+
+    char format_name[] = "RAWIMAGE\0";
+    unsigned char version[3] = {1, 0, 0};
+    unsigned char gray_flag = is_grayscale ? 1 : 0;
+    out.write(format_name, 10);
+    out.write(reinterpret_cast<const char*>(version), 3);
+    out.write(reinterpret_cast<const char*>(&width), 4);
+    out.write(reinterpret_cast<const char*>(&height), 4);
+    out.write(reinterpret_cast<const char*>(&gray_flag), 1);
+    bytes.resize(static_cast<size_t>(width) * (is_grayscale ? 1 : 3));
+    return out.good() || fail("Ошибка записи в файл: " + filename);
+}
+
+bool ImageRowWriter::openCompressed(
+    const std::string& name, uint32_t w, uint32_t h, const std::vector<ColorRGB>& palette) {
+    if (palette.empty() || palette.size() > 256) {
+        filename = name;
+        return fail("Палитра CMPRIMAGE должна содержать от 1 до 256 цветов: " + name);
+    }
+    if (!open(name, Format::CMPRIMAGE, w, h)) {
+        return false;
+    }
+
+    char format_name[] = "CMPRIMAGE\0";
+    unsigned char version[3] = {6, 6, 6};
+    unsigned char pow = 0;
+    while ((size_t{1} << pow) < palette.size()) {
+        pow++;
+    }
+    out.write(format_name, 10);
+    out.write(reinterpret_cast<const char*>(version), 3);
+    out.write(reinterpret_cast<const char*>(&width), 4);
+    out.write(reinterpret_cast<const char*>(&height), 4);
+    out.write(reinterpret_cast<const char*>(&pow), 1);
+    for (const ColorRGB& color : palette) {
+        out.write(reinterpret_cast<const char*>(&color.r), 1);
+        out.write(reinterpret_cast<const char*>(&color.g), 1);
+        out.write(reinterpret_cast<const char*>(&color.b), 1);
+    }
+    // Readers take 2^pow colors by position, so a shorter palette is padded with black.
+    const char padding[3] = {0, 0, 0};
+    for (size_t i = palette.size(); i < (size_t{1} << pow); ++i) {
+        out.write(padding, 3);
+    }
+    return out.good() || fail("Ошибка записи в файл: " + filename);
+}
+
+bool ImageRowWriter::writeRow(std::span<const ColorRGB> row) {
+    if (!checkRow(format != Format::CMPRIMAGE, row.size())) {
+        return false;
+    }
+    if (format == Format::BMP) {
+        for (size_t x = 0; x < row.size(); ++x) {
+            bytes[3 * x] = row[x].b;
+            bytes[3 * x + 1] = row[x].g;
+            bytes[3 * x + 2] = row[x].r;
+        }
+    } else if (is_grayscale) {
+        for (size_t x = 0; x < row.size(); ++x) {
+            bytes[x] = row[x].r;
+        }
+    } else {
+        std::memcpy(bytes.data(), row.data(), bytes.size());
+    }
+    out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    return out.good() || fail("Ошибка записи в файл: " + filename);
+}
+
+bool ImageRowWriter::writeRow(std::span<const uint8_t> ids) {
+    if (!checkRow(format == Format::CMPRIMAGE, ids.size())) {
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(ids.data()), ids.size());
+    return out.good() || fail("Ошибка записи в файл: " + filename);
+}
+
+bool ImageRowWriter::finish() {
+    if (failed) {
+        return false;
+    }
+    if (rows_written != height) {
+        return fail("Записано " + std::to_string(rows_written) + " строк из " +
+                    std::to_string(height) + ": " + filename);
+    }
+    if (format == Format::RAWIMAGE) {
+        out.write("RAWIMGEND\0", 10);
+    } else if (format == Format::CMPRIMAGE) {
+        out.write("CMPRIMGEND\0", 10);
+    }
+    out.close();
+    if (out.fail()) {
+        return fail("Ошибка записи в файл: " + filename);
+    }
+    // Further calls fail until the writer is opened again.
+    failed = true;
+    LOG_INFO("Файл успешно записан: ", filename);
+    return true;
+}
+
+bool ImageRowWriter::checkRow(bool matches_format, size_t row_length) {
+    if (failed) {
+        return false;
+    }
+    if (!matches_format) {
+        return fail("Строка не соответствует формату файла: " + filename);
+    }
+    if (row_length != width || rows_written == height) {
+        return fail("Строка не соответствует размерам изображения: " + filename);
+    }
+    ++rows_written;
+    return true;
+}
+
+bool ImageRowWriter::fail(const std::string& message) {
+    failed = true;
+    handleLogMessage(message, Severity::ERROR);
+    return false;
+}
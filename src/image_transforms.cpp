@@ -1,35 +1,80 @@
 #include "image_transforms.h"
+#include "buffer_pool.h"
 #include "error_handlers.h"
+#include "fft.h"
 #include "images.h"
+#include "metrics.h"
+#include "parallel.h"
 #include <cmath>
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <complex>
 #include <stdexcept>
+#include <type_traits>
 
-static void rotate90(UncompressedImage& img, ColorRGB fill_color, bool smart_gap_interpolation) {
-    uint32_t original_width = img.getWidth();
-    uint32_t original_height = img.getHeight();
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
-    std::vector<Pixel> rotated_pixels(original_width * original_height, Pixel{fill_color.r, fill_color.g, fill_color.b});
-    uint32_t new_width = original_height;
-    uint32_t new_height = original_width;
+template <typename Image>
+static uint64_t pixelCount(const Image& img) {
+    return static_cast<uint64_t>(img.getWidth()) * img.getHeight();
+}
 
-    for (uint32_t y = 0; y < original_height; ++y) {
-        for (uint32_t x = 0; x < original_width; ++x) {
-            uint32_t new_x = original_height - 1 - y;
-            uint32_t new_y = x;
-            rotated_pixels[new_y * new_width + new_x] = img.getPixel(x, y);
-        }
-    }
+static uint64_t imageBytes(const UncompressedImage& img) {
+    return pixelCount(img) * (img.hasGrayStorage() ? 1 : 3);
+}
 
-    img.setWidth(new_width);
-    img.setHeight(new_height);
-    img.setPixels(rotated_pixels);
+static uint64_t imageBytes(const CompressedImage& img) { return pixelCount(img); }
 
-    if (smart_gap_interpolation) {
+// Images smaller than this are transformed on the calling thread.
+constexpr size_t MIN_PARALLEL_PIXELS = 1 << 16;
+
+// Minimal band of rows of the given length that is worth a thread of its own.
+static size_t minParallelRows(size_t row_length) {
+    return std::max<size_t>(1, MIN_PARALLEL_PIXELS / std::max<size_t>(row_length, 1));
+}
+
+template <typename T>
+static ImagePlane<T> rotateRows90(const ImagePlane<T>& rows) {
+    if (rows.empty()) {
+        return {};
     }
+    constexpr size_t TILE_COLUMNS = 64;
+    size_t original_height = rows.size();
+    size_t original_width = rows.rowLength();
+    // The output plane comes from the pool uninitialized, so each output row is first touched
+    // (and placed, on NUMA hosts) by the band that fills it.
+    ImagePlane<T> rotated(original_height, original_width);
+    parallelForBands(original_width, minParallelRows(original_height), [&](size_t begin, size_t end) {
+        for (size_t x0 = begin; x0 < end; x0 += TILE_COLUMNS) {
+            size_t x1 = std::min(x0 + TILE_COLUMNS, end);
+            for (size_t y = 0; y < original_height; ++y) {
+                const T* row = rows[y].data();
+                for (size_t x = x0; x < x1; ++x) {
+                    rotated[x][original_height - 1 - y] = row[x];
+                }
+            }
+        }
+    });
+    return rotated;
+}
+
+static void rotate90(UncompressedImage& img, ColorRGB fill_color, bool smart_gap_interpolation) {
+    uint32_t original_width = img.getWidth();
+    uint32_t original_height = img.getHeight();
+    if (img.hasGrayStorage()) {
+        img.setGrayData(rotateRows90(img.getGrayData()));
+    } else {
+        img.setImageData(rotateRows90(img.getImageData()));
+    }
+    img.setWidth(original_height);
+    img.setHeight(original_width);
 }
 
 void rotate(UncompressedImage& img, int angle, ColorRGB fill_color, bool smart_gap_interpolation) {
+    STAGE_TIMER(timer, "rotate", pixelCount(img), imageBytes(img));
     angle = angle % 360;
     if (angle < 0) angle += 360;
 
@@ -43,65 +88,367 @@ void rotate(UncompressedImage& img, int angle, ColorRGB fill_color, bool smart_g
         rotate90(img, fill_color, smart_gap_interpolation);
     }
 
-    handleLogMessage("Вращение изображения выполнено на " + std::to_string(angle) + " градусов.", Severity::INFO);
+    LOG_INFO("Вращение изображения выполнено на ", angle, " градусов.");
 }
 
-void applyKernel(UncompressedImage& img, const std::vector<std::vector<int>>& kernel, int divisor) {
-    if (kernel.empty() || kernel.size() != kernel[0].size() || kernel.size() % 2 == 0) {
-        handleLogMessage("Некорректный размер ядра. Ядро должно быть квадратным и иметь нечётный размер.", Severity::ERROR, 1);
-        return;
+static void rotateIndicesRightAngle(CompressedImage& img, int quarter_turns) {
+    uint32_t width = img.getWidth();
+    uint32_t height = img.getHeight();
+    const auto& rows = img.getImageData();
+    bool swapped = quarter_turns % 2 == 1;
+    uint32_t new_width = swapped ? height : width;
+    uint32_t new_height = swapped ? width : height;
+
+    ImagePlane<uint8_t> rotated(new_width, new_height);
+    for (uint32_t y = 0; y < new_height; ++y) {
+        std::span<uint8_t> row = rotated[y];
+        for (uint32_t x = 0; x < new_width; ++x) {
+            switch (quarter_turns) {
+                case 1: row[x] = rows[height - 1 - x][y]; break;
+                case 2: row[x] = rows[height - 1 - y][width - 1 - x]; break;
+                default: row[x] = rows[x][width - 1 - y]; break;
+            }
+        }
     }
 
-    int kernel_size = kernel.size();
-    int offset = kernel_size / 2;
+    img.setWidth(new_width);
+    img.setHeight(new_height);
+    img.setImageData(std::move(rotated));
+}
+
+static uint8_t fillColorId(CompressedImage& img, const ColorRGB& fill_color) {
+    auto found = img.getColorToId().find(fill_color);
+    if (found != img.getColorToId().end()) {
+        return found->second;
+    }
+    if (img.getIdToColor().size() == 256) {
+        mergeDuplicateColors(img);
+    }
+    if (img.getIdToColor().size() == 256) {
+        handleLogMessage("Палитра заполнена, цвет заливки заменён ближайшим цветом палитры.", Severity::WARNING);
+        return findClosestColorId(fill_color, img.getIdToColor());
+    }
 
+    std::map<uint8_t, ColorRGB> id_to_color = img.getIdToColor();
+    std::unordered_map<ColorRGB, uint8_t, ColorHash> color_to_id = img.getColorToId();
+    uint8_t id = 0;
+    while (id_to_color.count(id) != 0) {
+        ++id;
+    }
+    id_to_color[id] = fill_color;
+    color_to_id[fill_color] = id;
+    img.setIdToColor(std::move(id_to_color));
+    img.setColorToId(std::move(color_to_id));
+    return id;
+}
+
+// Clockwise like rotate90: every output pixel takes the source pixel under its rotated center.
+static void rotateIndicesArbitrary(CompressedImage& img, int angle, const ColorRGB& fill_color) {
+    double radians = angle * M_PI / 180;
+    double cos_angle = std::cos(radians);
+    double sin_angle = std::sin(radians);
     uint32_t width = img.getWidth();
     uint32_t height = img.getHeight();
-    std::vector<Pixel> original_pixels = img.getPixels();
-    std::vector<Pixel> new_pixels(width * height, Pixel{0, 0, 0});
+    auto new_width = static_cast<uint32_t>(
+        std::lround(width * std::abs(cos_angle) + height * std::abs(sin_angle)));
+    auto new_height = static_cast<uint32_t>(
+        std::lround(width * std::abs(sin_angle) + height * std::abs(cos_angle)));
+
+    uint8_t fill_id = fillColorId(img, fill_color);
+    const auto& rows = img.getImageData();
+    ImagePlane<uint8_t> rotated(new_width, new_height, fill_id);
+    for (uint32_t y = 0; y < new_height; ++y) {
+        double dy = y + 0.5 - new_height / 2.0;
+        for (uint32_t x = 0; x < new_width; ++x) {
+            double dx = x + 0.5 - new_width / 2.0;
+            double source_x = std::floor(dx * cos_angle + dy * sin_angle + width / 2.0);
+            double source_y = std::floor(dy * cos_angle - dx * sin_angle + height / 2.0);
+            if (source_x >= 0 && source_x < width && source_y >= 0 && source_y < height) {
+                rotated[y][x] = rows[static_cast<uint32_t>(source_y)][static_cast<uint32_t>(source_x)];
+            }
+        }
+    }
+
+    img.setWidth(new_width);
+    img.setHeight(new_height);
+    img.setImageData(std::move(rotated));
+}
+
+void rotate(CompressedImage& img, int angle, ColorRGB fill_color, bool smart_gap_interpolation) {
+    STAGE_TIMER(timer, "rotate(CompressedImage)", pixelCount(img), imageBytes(img));
+    angle = angle % 360;
+    if (angle < 0) angle += 360;
+    if (angle == 0 || pixelCount(img) == 0) {
+        return;
+    }
+
+    if (angle % 90 == 0) {
+        rotateIndicesRightAngle(img, angle / 90);
+    } else {
+        rotateIndicesArbitrary(img, angle, fill_color);
+    }
+    LOG_INFO("Вращение изображения (CompressedImage) выполнено на ", angle, " градусов.");
+}
+
+// Relative costs per output pixel, measured on 1024x1024 RGB images: the direct loops take one
+// unit per tap plus DIRECT_ROW_COST per kernel row, and the FFT path FFT_COST units per tile pixel
+// and level of the transform. Square kernels break even at about 7x7; a 1x33 row stays direct,
+// while a 33x1 column, slower to read directly, goes through the FFT.
+constexpr double DIRECT_ROW_COST = 2;
+constexpr double FFT_COST = 3.5;
+// Largest |sum| the FFT path accepts: its double rounding error then stays far below 0.5, so
+// rounding recovers exactly the integer sums of the direct path.
+constexpr int64_t FFT_MAX_SUM = int64_t{1} << 24;
+// Smallest side of an FFT tile.
+constexpr size_t FFT_MIN_TILE = 64;
+
+static uint8_t channelValue(uint8_t gray, int channel) { return gray; }
+
+static uint8_t channelValue(const ColorRGB& color, int channel) {
+    return channel == 0 ? color.r : (channel == 1 ? color.g : color.b);
+}
+
+static void setChannelValue(uint8_t& gray, int channel, uint8_t value) { gray = value; }
 
-    for (uint32_t y = 0; y < height; ++y) {
-        for (uint32_t x = 0; x < width; ++x) {
-            int sum_r = 0, sum_g = 0, sum_b = 0;
+static void setChannelValue(ColorRGB& color, int channel, uint8_t value) {
+    (channel == 0 ? color.r : (channel == 1 ? color.g : color.b)) = value;
+}
+
+// Overlap-save tiles: powers of two at least four times the kernel, no larger than the padded image.
+struct FFTTiles {
+    size_t rows;
+    size_t columns;
+    size_t valid_rows;
+    size_t valid_columns;
+};
+
+static FFTTiles fftTiles(size_t kernel_rows, size_t kernel_columns, uint32_t width, uint32_t height) {
+    FFTTiles tiles;
+    tiles.rows = std::min(std::bit_ceil(std::max<size_t>(FFT_MIN_TILE, 4 * (kernel_rows - 1))),
+                          std::bit_ceil<size_t>(height + kernel_rows - 1));
+    tiles.columns = std::min(std::bit_ceil(std::max<size_t>(FFT_MIN_TILE, 4 * (kernel_columns - 1))),
+                             std::bit_ceil<size_t>(width + kernel_columns - 1));
+    tiles.valid_rows = tiles.rows - kernel_rows + 1;
+    tiles.valid_columns = tiles.columns - kernel_columns + 1;
+    return tiles;
+}
 
-            for (int ky = 0; ky < kernel_size; ++ky) {
-                for (int kx = 0; kx < kernel_size; ++kx) {
-                    int ix = x + kx - offset;
-                    int iy = y + ky - offset;
+static bool useFFTConvolution(const std::vector<std::vector<int>>& kernel, uint32_t width, uint32_t height) {
+    int64_t weight = 0;
+    for (const auto& row : kernel) {
+        for (int value : row) {
+            weight += std::abs(static_cast<int64_t>(value));
+        }
+    }
+    if (255 * weight > FFT_MAX_SUM) {
+        return false;
+    }
 
-                    ix = std::clamp(ix, 0, static_cast<int>(width) - 1);
-                    iy = std::clamp(iy, 0, static_cast<int>(height) - 1);
+    FFTTiles tiles = fftTiles(kernel.size(), kernel[0].size(), width, height);
+    double tile_size = static_cast<double>(tiles.rows * tiles.columns);
+    double tile_count = static_cast<double>((height + tiles.valid_rows - 1) / tiles.valid_rows)
+        * ((width + tiles.valid_columns - 1) / tiles.valid_columns);
+    double fft_cost = FFT_COST * tile_count * tile_size * std::log2(tile_size)
+        / (static_cast<double>(width) * height);
+    double direct_cost = static_cast<double>(kernel.size() * kernel[0].size()) + DIRECT_ROW_COST * kernel.size();
+    return direct_cost > fft_cost;
+}
 
-                    Pixel p = original_pixels[iy * width + ix];
-                    sum_r += p.r * kernel[ky][kx];
-                    sum_g += p.g * kernel[ky][kx];
-                    sum_b += p.b * kernel[ky][kx];
+// Overlap-save convolution: each power-of-two tile of the border-replicated image is multiplied
+// by the kernel spectrum, and the part of the tile that did not wrap around is kept. Two channels
+// share one complex transform as its real and imaginary parts. Sums are rounded back to integers,
+// so division and clamping are those of the direct path.
+template <typename T>
+static ImagePlane<T> convolveFFT(
+    const ImagePlane<T>& rows, uint32_t width, uint32_t height,
+    const std::vector<std::vector<int>>& kernel, int divisor) {
+    constexpr int CHANNELS = std::is_same_v<T, ColorRGB> ? 3 : 1;
+    int kernel_rows = kernel.size();
+    int kernel_columns = kernel[0].size();
+    int offset_y = kernel_rows / 2;
+    int offset_x = kernel_columns / 2;
+    FFTTiles tiles = fftTiles(kernel_rows, kernel_columns, width, height);
+    size_t tile_rows = tiles.rows;
+    size_t tile_columns = tiles.columns;
+    size_t valid_rows = tiles.valid_rows;
+    size_t valid_columns = tiles.valid_columns;
+    size_t tile_size = tile_rows * tile_columns;
+
+    // Correlation is a product with the conjugate spectrum; the inverse scaling is folded in.
+    // The spectrum and the tiles are scratch and come from BufferPool.
+    PooledVector<std::complex<double>> spectrum(tile_size);
+    for (int ky = 0; ky < kernel_rows; ++ky) {
+        for (int kx = 0; kx < kernel_columns; ++kx) {
+            spectrum[ky * tile_columns + kx] = kernel[ky][kx];
+        }
+    }
+    fft2D(spectrum.data(), tile_rows, tile_columns);
+    for (auto& value : spectrum) {
+        value = std::conj(value) / static_cast<double>(tile_size);
+    }
+
+    ImagePlane<T> new_rows(width, height);
+    size_t tile_count_y = (height + valid_rows - 1) / valid_rows;
+    size_t tile_count_x = (width + valid_columns - 1) / valid_columns;
+    parallelForBands(tile_count_y, 1, [&](size_t begin, size_t end) {
+        PooledVector<std::complex<double>> tile(tile_size);
+        for (size_t tile_y = begin; tile_y < end; ++tile_y) {
+            size_t y0 = tile_y * valid_rows;
+            size_t y1 = std::min<size_t>(y0 + valid_rows, height);
+            for (size_t tile_x = 0; tile_x < tile_count_x; ++tile_x) {
+                size_t x0 = tile_x * valid_columns;
+                size_t x1 = std::min<size_t>(x0 + valid_columns, width);
+                for (int channel = 0; channel < CHANNELS; channel += 2) {
+                    bool paired = channel + 1 < CHANNELS;
+                    for (size_t i = 0; i < tile_rows; ++i) {
+                        std::span<const T> row = rows[std::clamp<int64_t>(static_cast<int64_t>(y0 + i) - offset_y, 0, height - 1)];
+                        for (size_t j = 0; j < tile_columns; ++j) {
+                            const T& pixel = row[std::clamp<int64_t>(static_cast<int64_t>(x0 + j) - offset_x, 0, width - 1)];
+                            tile[i * tile_columns + j] = {
+                                static_cast<double>(channelValue(pixel, channel)),
+                                paired ? static_cast<double>(channelValue(pixel, channel + 1)) : 0.0};
+                        }
+                    }
+                    fft2D(tile.data(), tile_rows, tile_columns);
+                    for (size_t i = 0; i < tile_size; ++i) {
+                        double re = tile[i].real() * spectrum[i].real() - tile[i].imag() * spectrum[i].imag();
+                        double im = tile[i].real() * spectrum[i].imag() + tile[i].imag() * spectrum[i].real();
+                        tile[i] = {re, im};
+                    }
+                    fft2D(tile.data(), tile_rows, tile_columns, true);
+
+                    for (size_t y = y0; y < y1; ++y) {
+                        const std::complex<double>* sums = tile.data() + (y - y0) * tile_columns;
+                        for (size_t x = x0; x < x1; ++x) {
+                            int64_t first = std::llround(sums[x - x0].real()) / divisor;
+                            setChannelValue(new_rows[y][x], channel, static_cast<uint8_t>(std::clamp<int64_t>(first, 0, 255)));
+                            if (paired) {
+                                int64_t second = std::llround(sums[x - x0].imag()) / divisor;
+                                setChannelValue(new_rows[y][x], channel + 1, static_cast<uint8_t>(std::clamp<int64_t>(second, 0, 255)));
+                            }
+                        }
+                    }
                 }
             }
+        }
+    });
+    return new_rows;
+}
 
-            sum_r = std::clamp(sum_r / divisor, 0, 255);
-            sum_g = std::clamp(sum_g / divisor, 0, 255);
-            sum_b = std::clamp(sum_b / divisor, 0, 255);
+static void applyKernelGray(
+    UncompressedImage& img, const std::vector<std::vector<int>>& kernel, int divisor) {
+    int kernel_rows = kernel.size();
+    int kernel_columns = kernel[0].size();
+    int offset_y = kernel_rows / 2;
+    int offset_x = kernel_columns / 2;
+
+    int width = img.getWidth();
+    int height = img.getHeight();
+    const auto& original_rows = img.getGrayData();
+    ImagePlane<uint8_t> new_rows(width, height);
+
+    parallelForBands(height, minParallelRows(width), [&](size_t begin, size_t end) {
+        for (int y = begin; y < static_cast<int>(end); ++y) {
+            for (int x = 0; x < width; ++x) {
+                int sum = 0;
+                for (int ky = 0; ky < kernel_rows; ++ky) {
+                    std::span<const uint8_t> row = original_rows[std::clamp(y + ky - offset_y, 0, height - 1)];
+                    for (int kx = 0; kx < kernel_columns; ++kx) {
+                        sum += row[std::clamp(x + kx - offset_x, 0, width - 1)] * kernel[ky][kx];
+                    }
+                }
+                new_rows[y][x] = static_cast<uint8_t>(std::clamp(sum / divisor, 0, 255));
+            }
+        }
+    });
+
+    img.setGrayData(std::move(new_rows));
+}
+
+void applyKernel(UncompressedImage& img, const std::vector<std::vector<int>>& kernel, int divisor) {
+    STAGE_TIMER(timer, "applyKernel", pixelCount(img), imageBytes(img));
+    bool rectangular = !kernel.empty() && !kernel[0].empty()
+        && std::all_of(kernel.begin(), kernel.end(), [&](const auto& row) { return row.size() == kernel[0].size(); });
+    if (!rectangular) {
+        handleLogMessage("Некорректный размер ядра. Строки ядра должны быть непустыми и одинаковой длины.", Severity::ERROR, 1);
+        return;
+    }
+    if (img.getWidth() == 0 || img.getHeight() == 0) {
+        return;
+    }
 
-            new_pixels[y * width + x] = Pixel{static_cast<uint8_t>(sum_r), static_cast<uint8_t>(sum_g), static_cast<uint8_t>(sum_b)};
+    if (useFFTConvolution(kernel, img.getWidth(), img.getHeight())) {
+        if (img.hasGrayStorage()) {
+            img.setGrayData(convolveFFT(img.getGrayData(), img.getWidth(), img.getHeight(), kernel, divisor));
+        } else {
+            img.setImageData(convolveFFT(img.getImageData(), img.getWidth(), img.getHeight(), kernel, divisor));
         }
+        LOG_INFO("Применение ядра фильтра через БПФ выполнено.");
+        return;
     }
 
-    img.setPixels(new_pixels);
-    handleLogMessage("Применение ядра фильтра выполнено.", Severity::INFO);
+    if (img.hasGrayStorage()) {
+        applyKernelGray(img, kernel, divisor);
+        LOG_INFO("Применение ядра фильтра выполнено.");
+        return;
+    }
+
+    int kernel_rows = kernel.size();
+    int kernel_columns = kernel[0].size();
+    int offset_y = kernel_rows / 2;
+    int offset_x = kernel_columns / 2;
+
+    uint32_t width = img.getWidth();
+    uint32_t height = img.getHeight();
+    const auto& original_rows = img.getImageData();
+    ImagePlane<ColorRGB> new_rows(width, height);
+
+    parallelForBands(height, minParallelRows(width), [&](size_t begin, size_t end) {
+        for (uint32_t y = begin; y < end; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                int sum_r = 0, sum_g = 0, sum_b = 0;
+
+                for (int ky = 0; ky < kernel_rows; ++ky) {
+                    for (int kx = 0; kx < kernel_columns; ++kx) {
+                        int ix = x + kx - offset_x;
+                        int iy = y + ky - offset_y;
+
+                        ix = std::clamp(ix, 0, static_cast<int>(width) - 1);
+                        iy = std::clamp(iy, 0, static_cast<int>(height) - 1);
+
+                        const ColorRGB& p = original_rows[iy][ix];
+                        sum_r += p.r * kernel[ky][kx];
+                        sum_g += p.g * kernel[ky][kx];
+                        sum_b += p.b * kernel[ky][kx];
+                    }
+                }
+
+                sum_r = std::clamp(sum_r / divisor, 0, 255);
+                sum_g = std::clamp(sum_g / divisor, 0, 255);
+                sum_b = std::clamp(sum_b / divisor, 0, 255);
+
+                new_rows[y][x] = ColorRGB{static_cast<uint8_t>(sum_r), static_cast<uint8_t>(sum_g), static_cast<uint8_t>(sum_b)};
+            }
+        }
+    });
+
+    img.setImageData(std::move(new_rows));
+    LOG_INFO("Применение ядра фильтра выполнено.");
 }
 
 void sharpen(UncompressedImage& img) {
+    STAGE_TIMER(timer, "sharpen", pixelCount(img), imageBytes(img));
     std::vector<std::vector<int>> sharpen_kernel = {
         { 0, -1,  0},
         {-1,  5, -1},
         { 0, -1,  0}
     };
     applyKernel(img, sharpen_kernel, 1);
-    handleLogMessage("Фильтр резкости применён.", Severity::INFO);
+    LOG_INFO("Фильтр резкости применён.");
 }
 
 void gaussianBlurApprox(UncompressedImage& img, bool hard_blur) {
+    STAGE_TIMER(timer, "gaussianBlurApprox", pixelCount(img), imageBytes(img));
     std::vector<std::vector<int>> gaussian_kernel;
     int divisor = 1;
 
@@ -113,102 +460,517 @@ void gaussianBlurApprox(UncompressedImage& img, bool hard_blur) {
         };
         divisor = 16;
     } else {
-        gaussian_kernel = {
-            {1, 1, 1},
-            {1, 1, 1},
-            {1, 1, 1}
-        };
-        divisor = 9;
+        // The 3x3 box of ones / 9, with the same results.
+        boxBlur(img, 1);
+        LOG_INFO("Гауссово размытие применено.");
+        return;
     }
 
     applyKernel(img, gaussian_kernel, divisor);
-    handleLogMessage("Гауссово размытие применено.", Severity::INFO);
+    LOG_INFO("Гауссово размытие применено.");
+}
+
+// Mean of every (2 * radius + 1)^2 window with replicated borders in O(1) per pixel: each band
+// keeps per-column sums of the rows under the window and slides them down one row at a time, and
+// a running sum slides along every row of column sums.
+template <typename T>
+static ImagePlane<T> boxBlurRows(
+    const ImagePlane<T>& rows, uint32_t width, uint32_t height, int radius,
+    bool round_to_nearest) {
+    constexpr size_t CHANNELS = sizeof(T);
+    uint64_t area = static_cast<uint64_t>(2 * radius + 1) * (2 * radius + 1);
+    // (sum * reciprocal) >> 40 == sum / area for sums below 2^24 while area < 2^16: the error of
+    // the reciprocal stays below 1 / area.
+    uint64_t reciprocal = ((uint64_t{1} << 40) + area - 1) / area;
+    uint32_t bias = round_to_nearest ? area / 2 : 0;
+    int64_t last_row = height - 1;
+    int64_t last_column = width - 1;
+    auto rowBytes = [&](int64_t y) {
+        return reinterpret_cast<const uint8_t*>(rows[std::clamp<int64_t>(y, 0, last_row)].data());
+    };
+
+    ImagePlane<T> blurred(width, height);
+    parallelForBands(height, minParallelRows(width), [&](size_t begin, size_t end) {
+        // Sums wrap around in unsigned arithmetic while a row is swapped, but never end negative.
+        PooledVector<uint32_t> column_sums(width * CHANNELS, 0);
+        for (int64_t y = static_cast<int64_t>(begin) - radius; y <= static_cast<int64_t>(begin) + radius; ++y) {
+            const uint8_t* row = rowBytes(y);
+            for (size_t i = 0; i < column_sums.size(); ++i) {
+                column_sums[i] += row[i];
+            }
+        }
+
+        for (size_t y = begin; y < end; ++y) {
+            uint8_t* out = reinterpret_cast<uint8_t*>(blurred[y].data());
+            std::array<uint32_t, CHANNELS> window{};
+            for (int64_t x = -radius; x <= radius; ++x) {
+                for (size_t c = 0; c < CHANNELS; ++c) {
+                    window[c] += column_sums[std::clamp<int64_t>(x, 0, last_column) * CHANNELS + c];
+                }
+            }
+            for (int64_t x = 0; x <= last_column; ++x) {
+                size_t incoming = std::min<int64_t>(x + radius + 1, last_column) * CHANNELS;
+                size_t outgoing = std::max<int64_t>(x - radius, 0) * CHANNELS;
+                for (size_t c = 0; c < CHANNELS; ++c) {
+                    out[x * CHANNELS + c] = static_cast<uint8_t>(((window[c] + bias) * reciprocal) >> 40);
+                    window[c] += column_sums[incoming + c] - column_sums[outgoing + c];
+                }
+            }
+
+            const uint8_t* incoming = rowBytes(y + radius + 1);
+            const uint8_t* outgoing = rowBytes(static_cast<int64_t>(y) - radius);
+            for (size_t i = 0; i < column_sums.size(); ++i) {
+                column_sums[i] += incoming[i] - outgoing[i];
+            }
+        }
+    });
+    return blurred;
+}
+
+static void boxBlurPass(UncompressedImage& img, int radius, bool round_to_nearest) {
+    if (img.hasGrayStorage()) {
+        img.setGrayData(boxBlurRows(img.getGrayData(), img.getWidth(), img.getHeight(), radius, round_to_nearest));
+    } else {
+        img.setImageData(boxBlurRows(img.getImageData(), img.getWidth(), img.getHeight(), radius, round_to_nearest));
+    }
+}
+
+void boxBlur(UncompressedImage& img, int radius) {
+    STAGE_TIMER(timer, "boxBlur", pixelCount(img), imageBytes(img));
+    if (radius < 1 || radius > MAX_BOX_BLUR_RADIUS) {
+        handleLogMessage("Некорректный радиус размытия. Радиус должен быть от 1 до 100.", Severity::ERROR, 1);
+        return;
+    }
+    if (img.getWidth() == 0 || img.getHeight() == 0) {
+        return;
+    }
+    boxBlurPass(img, radius, false);
+    LOG_INFO("Размытие по квадрату радиуса ", radius, " применено.");
+}
+
+void gaussianBlur(UncompressedImage& img, double sigma) {
+    STAGE_TIMER(timer, "gaussianBlur", pixelCount(img), imageBytes(img));
+    // Wider boxes would break the area and sum bounds of the reciprocal division in boxBlurRows.
+    if (!(sigma > 0) || sigma > MAX_GAUSSIAN_SIGMA) {
+        handleLogMessage("Некорректное значение сигмы. Сигма должна быть от 0 до 100.", Severity::ERROR, 1);
+        return;
+    }
+    if (img.getWidth() == 0 || img.getHeight() == 0) {
+        return;
+    }
+
+    // Three boxes whose combined variance is closest to sigma^2: the first `smaller` boxes have
+    // the largest odd width not above the ideal one, the rest are two pixels wider.
+    constexpr int PASSES = 3;
+    double variance = sigma * sigma;
+    int lower_width = static_cast<int>(std::floor(std::sqrt(12 * variance / PASSES + 1)));
+    if (lower_width % 2 == 0) {
+        --lower_width;
+    }
+    int smaller = static_cast<int>(std::lround(
+        (12 * variance - PASSES * lower_width * lower_width - 4 * PASSES * lower_width - 3 * PASSES)
+        / (-4.0 * lower_width - 4)));
+    for (int pass = 0; pass < PASSES; ++pass) {
+        int box_width = pass < smaller ? lower_width : lower_width + 2;
+        // Each pass rounds to nearest, so three passes do not darken the image.
+        if (box_width > 1) {
+            boxBlurPass(img, box_width / 2, true);
+        }
+    }
+    LOG_INFO("Гауссово размытие с сигмой ", sigma, " применено.");
 }
 
 void edgeDetect(UncompressedImage& img) {
+    STAGE_TIMER(timer, "edgeDetect", pixelCount(img), imageBytes(img));
     std::vector<std::vector<int>> edge_kernel = {
         {-1, -1, -1},
         {-1,  8, -1},
         {-1, -1, -1}
     };
     applyKernel(img, edge_kernel, 1);
-    handleLogMessage("Обнаружение краёв выполнено.", Severity::INFO);
+    LOG_INFO("Обнаружение краёв выполнено.");
+}
+
+// 255 - value of every byte of the plane; a plain loop that the compiler vectorizes, cheaper than
+// any table lookup.
+template <typename T>
+static void invertPlane(ImagePlane<T>& plane) {
+    uint8_t* data = reinterpret_cast<uint8_t*>(plane.data());
+    parallelForBands(plane.pixelCount(), MIN_PARALLEL_PIXELS, [data](size_t begin, size_t end) {
+        // Local bounds: stores through uint8_t* could alias captured ones and stop vectorization.
+        uint8_t* first = data + begin * sizeof(T);
+        uint8_t* last = data + end * sizeof(T);
+        std::transform(first, last, first, [](uint8_t value) { return static_cast<uint8_t>(~value); });
+    });
 }
 
 void negative(UncompressedImage& img) {
-    std::vector<Pixel> pixels = img.getPixels();
-    for (auto& pixel : pixels) {
-        pixel.r = 255 - pixel.r;
-        pixel.g = 255 - pixel.g;
-        pixel.b = 255 - pixel.b;
+    STAGE_TIMER(timer, "negative", pixelCount(img), imageBytes(img));
+    if (img.hasGrayStorage()) {
+        invertPlane(img.getMutableGrayData());
+    } else {
+        invertPlane(img.getMutableImageData());
     }
-    img.setPixels(pixels);
-    handleLogMessage("Инверсия цветов (UncompressedImage) выполнена.", Severity::INFO);
+    LOG_INFO("Инверсия цветов (UncompressedImage) выполнена.");
 }
 
 void negative(CompressedImage& img) {
-    std::map<uint8_t, ColorRGB> colorTable = img.getColorTable();
-    for (auto& [id, color] : colorTable) {
-        color.r = 255 - color.r;
-        color.g = 255 - color.g;
-        color.b = 255 - color.b;
-    }
-    img.setColorTable(colorTable);
-    handleLogMessage("Инверсия цветов (CompressedImage) выполнена.", Severity::INFO);
+    STAGE_TIMER(timer, "negative(CompressedImage)", pixelCount(img), imageBytes(img));
+    static const ChannelLUT negative_lut = negativeLUT();
+    applyChannelLUT(img, negative_lut);
+    LOG_INFO("Инверсия цветов (CompressedImage) выполнена.");
 }
 
 void toGrayscale(UncompressedImage& img) {
-    if (img.isGrayscale()) {
-        handleLogMessage("Изображение уже в градациях серого.", Severity::INFO);
+    STAGE_TIMER(timer, "toGrayscale", pixelCount(img), imageBytes(img));
+    if (img.getIsGrayscale()) {
+        LOG_INFO("Изображение уже в градациях серого.");
         return;
     }
 
-    std::vector<Pixel> pixels = img.getPixels();
-    for (auto& pixel : pixels) {
-        uint8_t gray = colorToGrayscale(pixel);
-        pixel.r = pixel.g = pixel.b = gray;
-    }
-    img.setPixels(pixels);
-    img.setGrayscale(true);
-    handleLogMessage("Преобразование в градации серого (UncompressedImage) выполнено.", Severity::INFO);
+    // The image keeps RGB storage: every row is converted into a buffer and spread back over it.
+    ImagePlane<ColorRGB>& pixels = img.getMutableImageData();
+    size_t width = img.getWidth();
+    parallelForBands(pixels.size(), minParallelRows(width), [&](size_t begin, size_t end) {
+        std::vector<uint8_t> gray(width);
+        for (size_t y = begin; y < end; ++y) {
+            std::span<ColorRGB> row = pixels[y];
+            toGrayscaleRow(row.data(), gray.data(), row.size());
+            grayToColorRow(gray.data(), row.data(), row.size());
+        }
+    });
+    img.setIsGrayscale(true);
+    LOG_INFO("Преобразование в градации серого (UncompressedImage) выполнено.");
 }
 
 void toGrayscale(CompressedImage& img) {
-    std::map<uint8_t, ColorRGB> colorTable = img.getColorTable();
-    for (auto& [id, color] : colorTable) {
+    STAGE_TIMER(timer, "toGrayscale(CompressedImage)", pixelCount(img), imageBytes(img));
+    applyPointOp(img, [](const ColorRGB& color) {
         uint8_t gray = colorToGrayscale(color);
-        color.r = color.g = color.b = gray;
-    }
-    img.setColorTable(colorTable);
-    handleLogMessage("Преобразование в градации серого (CompressedImage) выполнено.", Severity::INFO);
+        return ColorRGB{gray, gray, gray};
+    });
+    LOG_INFO("Преобразование в градации серого (CompressedImage) выполнено.");
 }
 
-template <typename Image>
-void mirror(Image& img, bool horizontal) {
-    uint32_t width = img.getWidth();
-    uint32_t height = img.getHeight();
+#if defined(__x86_64__) || defined(__i386__)
+// Looks 64 bytes up in a 256-entry table held in four registers: one two-register permute per
+// half of the table, picked by the top bit of each byte.
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static inline __m512i lookupBytesVBMI(__m512i values, const __m512i* table) {
+    __m512i low = _mm512_permutex2var_epi8(table[0], values, table[1]);
+    __m512i high = _mm512_permutex2var_epi8(table[2], values, table[3]);
+    return _mm512_mask_mov_epi8(low, _mm512_movepi8_mask(values), high);
+}
 
-    std::vector<Pixel> pixels = img.getPixels();
+// A plane of ColorRGB is one run of bytes that starts on a red value and cycles through red, green
+// and blue; planes of gray values are mapped with the same code when all three tables are equal.
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static void applyChannelLUTsVBMI(uint8_t* data, size_t count, const ChannelLUT* const luts[3]) {
+    __m512i tables[3][4];
+    for (size_t channel = 0; channel < 3; ++channel) {
+        for (size_t part = 0; part < 4; ++part) {
+            tables[channel][part] = _mm512_loadu_si512(luts[channel]->data() + 64 * part);
+        }
+    }
+    bool uniform = *luts[0] == *luts[1] && *luts[1] == *luts[2];
+    // Red and green lanes of a 64-byte block; 64 % 3 == 1, so blocks cycle through three phases.
+    __mmask64 red_lanes[3] = {}, green_lanes[3] = {};
+    for (size_t phase = 0; phase < 3; ++phase) {
+        for (size_t lane = 0; lane < 64; ++lane) {
+            size_t channel = (phase + lane) % 3;
+            red_lanes[phase] |= static_cast<__mmask64>(channel == 0) << lane;
+            green_lanes[phase] |= static_cast<__mmask64>(channel == 1) << lane;
+        }
+    }
 
-    if (horizontal) {
-        for (uint32_t y = 0; y < height; ++y) {
-            for (uint32_t x = 0; x < width / 2; ++x) {
-                std::swap(pixels[y * width + x], pixels[y * width + (width - 1 - x)]);
-            }
+    for (size_t offset = 0, phase = 0; offset < count; offset += 64, phase = (phase + 1) % 3) {
+        __mmask64 valid = count - offset >= 64 ? ~__mmask64{0} : (__mmask64{1} << (count - offset)) - 1;
+        __m512i values = _mm512_maskz_loadu_epi8(valid, data + offset);
+        __m512i result = lookupBytesVBMI(values, tables[2]);
+        if (!uniform) {
+            result = _mm512_mask_mov_epi8(result, red_lanes[phase], lookupBytesVBMI(values, tables[0]));
+            result = _mm512_mask_mov_epi8(result, green_lanes[phase], lookupBytesVBMI(values, tables[1]));
         }
-        handleLogMessage("Зеркальное отражение по горизонтали выполнено.", Severity::INFO);
-    } else {
-        for (uint32_t y = 0; y < height / 2; ++y) {
-            for (uint32_t x = 0; x < width; ++x) {
-                std::swap(pixels[y * width + x], pixels[(height - 1 - y) * width + x]);
-            }
+        _mm512_mask_storeu_epi8(data + offset, valid, result);
+    }
+}
+
+// Looks 32 bytes up in a 256-entry table split into 16 rows of 16 bytes, each broadcast to both
+// lanes. A row is selected by the high nibble: after XOR with the row's high nibble and a
+// saturating add of 0x70, only bytes of that row keep bit 7 clear, and pshufb zeroes the others.
+__attribute__((target("avx2")))
+static inline __m256i lookupBytesAVX2(__m256i values, const __m256i* table) {
+    const __m256i select_offset = _mm256_set1_epi8(0x70);
+    __m256i result = _mm256_setzero_si256();
+    for (int row = 0; row < 16; ++row) {
+        __m256i index = _mm256_adds_epu8(
+            _mm256_xor_si256(values, _mm256_set1_epi8(static_cast<char>(row << 4))), select_offset);
+        result = _mm256_or_si256(result, _mm256_shuffle_epi8(table[row], index));
+    }
+    return result;
+}
+
+// Maps bytes through a single table in 32-byte blocks and returns how many bytes it mapped; the
+// tail that does not fill a block is left to the caller. Three different tables would take three
+// lookups and two blends per block, no faster than the scalar loop, so they are not handled here.
+__attribute__((target("avx2")))
+static size_t applyLUTAVX2(uint8_t* data, size_t count, const ChannelLUT& lut) {
+    __m256i table[16];
+    for (size_t row = 0; row < 16; ++row) {
+        table[row] = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(lut.data() + 16 * row)));
+    }
+    size_t offset = 0;
+    for (; count - offset >= 32; offset += 32) {
+        __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + offset), lookupBytesAVX2(values, table));
+    }
+    return offset;
+}
+#endif
+
+// Bytes of a band start on a red value, so channels are counted from the band's start.
+static void applyChannelLUTsToBytes(uint8_t* data, size_t count, const ChannelLUT* const luts[3]) {
+    size_t i = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx512vbmi")) {
+        applyChannelLUTsVBMI(data, count, luts);
+        return;
+    }
+    if (__builtin_cpu_supports("avx2") && *luts[0] == *luts[1] && *luts[1] == *luts[2]) {
+        i = applyLUTAVX2(data, count, *luts[0]);
+    }
+#endif
+    for (size_t channel = i % 3; i < count; ++i, channel = channel == 2 ? 0 : channel + 1) {
+        data[i] = (*luts[channel])[data[i]];
+    }
+}
+
+template <typename T>
+static void applyChannelLUTs(ImagePlane<T>& plane, const ChannelLUT* const luts[3]) {
+    uint8_t* data = reinterpret_cast<uint8_t*>(plane.data());
+    parallelForBands(plane.pixelCount(), MIN_PARALLEL_PIXELS, [&](size_t begin, size_t end) {
+        applyChannelLUTsToBytes(data + begin * sizeof(T), (end - begin) * sizeof(T), luts);
+    });
+}
+
+void applyChannelLUT(
+    UncompressedImage& img, const ChannelLUT& lut_r, const ChannelLUT& lut_g, const ChannelLUT& lut_b) {
+    STAGE_TIMER(timer, "applyChannelLUT", pixelCount(img), imageBytes(img));
+    bool uniform = lut_r == lut_g && lut_g == lut_b;
+    if (img.hasGrayStorage() && !uniform) {
+        img.expandGrayscale();
+    }
+    const ChannelLUT* const luts[3] = {&lut_r, &lut_g, &lut_b};
+    if (img.hasGrayStorage()) {
+        applyChannelLUTs(img.getMutableGrayData(), luts);
+        return;
+    }
+
+    // ColorRGB is three packed bytes, so the plane is one contiguous run of channel values.
+    static_assert(sizeof(ColorRGB) == 3);
+    applyChannelLUTs(img.getMutableImageData(), luts);
+    if (!uniform) {
+        img.setIsGrayscale(false);
+    }
+}
+
+void applyChannelLUT(UncompressedImage& img, const ChannelLUT& lut) {
+    applyChannelLUT(img, lut, lut, lut);
+}
+
+void applyChannelLUT(
+    CompressedImage& img, const ChannelLUT& lut_r, const ChannelLUT& lut_g, const ChannelLUT& lut_b) {
+    applyPointOp(img, [&](const ColorRGB& color) {
+        return ColorRGB{lut_r[color.r], lut_g[color.g], lut_b[color.b]};
+    });
+}
+
+void applyChannelLUT(CompressedImage& img, const ChannelLUT& lut) {
+    applyChannelLUT(img, lut, lut, lut);
+}
+
+ChannelLUT negativeLUT() {
+    ChannelLUT lut;
+    for (int value = 0; value < 256; ++value) {
+        lut[value] = 255 - value;
+    }
+    return lut;
+}
+
+ChannelLUT gammaLUT(double gamma) {
+    if (gamma <= 0) {
+        handleLogMessage("Некорректное значение гаммы. Гамма должна быть положительной.", Severity::ERROR, 1);
+        return {};
+    }
+    ChannelLUT lut;
+    for (int value = 0; value < 256; ++value) {
+        lut[value] = static_cast<uint8_t>(std::lround(255.0 * std::pow(value / 255.0, 1.0 / gamma)));
+    }
+    return lut;
+}
+
+ChannelLUT levelsLUT(uint8_t black, uint8_t white, double gamma) {
+    if (black >= white || gamma <= 0) {
+        handleLogMessage("Некорректные уровни. Чёрная точка должна быть меньше белой, гамма положительной.", Severity::ERROR, 1);
+        return {};
+    }
+    ChannelLUT lut;
+    for (int value = 0; value < 256; ++value) {
+        double level = static_cast<double>(std::clamp<int>(value, black, white) - black) / (white - black);
+        lut[value] = static_cast<uint8_t>(std::lround(255.0 * std::pow(level, 1.0 / gamma)));
+    }
+    return lut;
+}
+
+ChannelLUT contrastLUT(double factor) {
+    ChannelLUT lut;
+    for (int value = 0; value < 256; ++value) {
+        long contrasted = std::lround((value - 127.5) * factor + 127.5);
+        lut[value] = static_cast<uint8_t>(std::clamp<long>(contrasted, 0, 255));
+    }
+    return lut;
+}
+
+size_t mergeDuplicateColors(CompressedImage& img) {
+    const std::map<uint8_t, ColorRGB>& id_to_color = img.getIdToColor();
+    const std::unordered_map<ColorRGB, uint8_t, ColorHash>& color_to_id = img.getColorToId();
+    if (id_to_color.size() == color_to_id.size()) {
+        return 0;
+    }
+
+    STAGE_TIMER(timer, "mergeDuplicateColors", pixelCount(img), imageBytes(img));
+    // The kept ids are renumbered 0..n-1 in ascending order: files store the palette by position.
+    uint8_t remap[256];
+    std::map<uint8_t, ColorRGB> merged;
+    std::unordered_map<ColorRGB, uint8_t, ColorHash> merged_ids;
+    for (uint32_t id = 0; id < 256; ++id) {
+        remap[id] = id;
+    }
+    for (const auto& [id, color] : id_to_color) {
+        auto [kept, inserted] = merged_ids.emplace(color, static_cast<uint8_t>(merged.size()));
+        if (inserted) {
+            merged[kept->second] = color;
         }
-        handleLogMessage("Зеркальное отражение по вертикали выполнено.", Severity::INFO);
+        remap[id] = kept->second;
     }
+    size_t dropped = id_to_color.size() - merged.size();
 
-    img.setPixels(pixels);
+    for (uint8_t& id : img.getMutableImageData().pixels()) {
+        id = remap[id];
+    }
+    img.setIdToColor(std::move(merged));
+    img.setColorToId(std::move(merged_ids));
+    LOG_INFO("Объединено повторяющихся цветов палитры: ", dropped, ".");
+    return dropped;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("ssse3")))
+static void reverseBytesSSSE3(uint8_t* data, size_t count) {
+    const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    uint8_t* left = data;
+    uint8_t* right = data + count;
+    for (; right - left >= 32; left += 16, right -= 16) {
+        __m128i left_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left));
+        __m128i right_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right - 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(left), _mm_shuffle_epi8(right_block, reverse));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(right - 16), _mm_shuffle_epi8(left_block, reverse));
+    }
+    std::reverse(left, right);
+}
+
+// Writes the 16 pixels held in a, b and c (48 bytes) to dst in reverse order.
+__attribute__((target("ssse3")))
+static inline void storeReversedColors(__m128i a, __m128i b, __m128i c, __m128i* dst) {
+    const __m128i first_from_c = _mm_setr_epi8(13, 14, 15, 10, 11, 12, 7, 8, 9, 4, 5, 6, 1, 2, 3, -1);
+    const __m128i first_from_b = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 14);
+    const __m128i second_from_a = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 15, -1);
+    const __m128i second_from_b = _mm_setr_epi8(15, -1, 11, 12, 13, 8, 9, 10, 5, 6, 7, 2, 3, 4, -1, 0);
+    const __m128i second_from_c = _mm_setr_epi8(-1, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i third_from_a = _mm_setr_epi8(-1, 12, 13, 14, 9, 10, 11, 6, 7, 8, 3, 4, 5, 0, 1, 2);
+    const __m128i third_from_b = _mm_setr_epi8(1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    _mm_storeu_si128(dst, _mm_or_si128(_mm_shuffle_epi8(c, first_from_c), _mm_shuffle_epi8(b, first_from_b)));
+    _mm_storeu_si128(dst + 1, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, second_from_a),
+                                                         _mm_shuffle_epi8(b, second_from_b)),
+                                            _mm_shuffle_epi8(c, second_from_c)));
+    _mm_storeu_si128(dst + 2, _mm_or_si128(_mm_shuffle_epi8(a, third_from_a), _mm_shuffle_epi8(b, third_from_b)));
+}
+
+__attribute__((target("ssse3")))
+static void reverseColorsSSSE3(ColorRGB* colors, size_t count) {
+    static_assert(sizeof(ColorRGB) == 3, "ColorRGB must be packed");
+    size_t left = 0;
+    size_t right = count;
+    for (; right - left >= 32; left += 16, right -= 16) {
+        auto* left_block = reinterpret_cast<__m128i*>(colors + left);
+        auto* right_block = reinterpret_cast<__m128i*>(colors + right - 16);
+        __m128i left_a = _mm_loadu_si128(left_block);
+        __m128i left_b = _mm_loadu_si128(left_block + 1);
+        __m128i left_c = _mm_loadu_si128(left_block + 2);
+        __m128i right_a = _mm_loadu_si128(right_block);
+        __m128i right_b = _mm_loadu_si128(right_block + 1);
+        __m128i right_c = _mm_loadu_si128(right_block + 2);
+        storeReversedColors(right_a, right_b, right_c, left_block);
+        storeReversedColors(left_a, left_b, left_c, right_block);
+    }
+    std::reverse(colors + left, colors + right);
+}
+#endif
+
+static void reverseBytes(uint8_t* data, size_t count) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("ssse3")) {
+        reverseBytesSSSE3(data, count);
+        return;
+    }
+#endif
+    std::reverse(data, data + count);
+}
+
+static void reverseColors(ColorRGB* colors, size_t count) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("ssse3")) {
+        reverseColorsSSSE3(colors, count);
+        return;
+    }
+#endif
+    std::reverse(colors, colors + count);
+}
+
+// Vertical mirroring swaps opposite rows of the plane in place.
+template <typename T>
+static void mirrorRows(ImagePlane<T>& rows, bool horizontal) {
+    if (!horizontal) {
+        size_t last_row = rows.size() - 1;
+        for (size_t y = 0; y < rows.size() / 2; ++y) {
+            std::swap_ranges(rows[y].begin(), rows[y].end(), rows[last_row - y].begin());
+        }
+        LOG_INFO("Зеркальное отражение по вертикали выполнено.");
+        return;
+    }
+    for (std::span<T> row : rows) {
+        if constexpr (std::is_same_v<T, ColorRGB>) {
+            reverseColors(row.data(), row.size());
+        } else {
+            reverseBytes(row.data(), row.size());
+        }
+    }
+    LOG_INFO("Зеркальное отражение по горизонтали выполнено.");
 }
 
-template void mirror(UncompressedImage& img, bool horizontal);
+template <>
+void mirror(UncompressedImage& img, bool horizontal) {
+    STAGE_TIMER(timer, "mirror", pixelCount(img), imageBytes(img));
+    if (img.hasGrayStorage()) {
+        mirrorRows(img.getMutableGrayData(), horizontal);
+    } else {
+        mirrorRows(img.getMutableImageData(), horizontal);
+    }
+}
 
-template void mirror(CompressedImage& img, bool horizontal);
+template <>
+void mirror(CompressedImage& img, bool horizontal) {
+    STAGE_TIMER(timer, "mirror(CompressedImage)", pixelCount(img), imageBytes(img));
+    mirrorRows(img.getMutableImageData(), horizontal);
+}
@@ -1,35 +1,131 @@
 #include "images.h"
 #include "error_handlers.h"
 #include "compressor_funcs.h" 
+#include "delta_codec.h"
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <utility>
+
+// Bytes between the read position and the 10-byte end signature. Sizes taken from a header are
+// checked against it before anything is allocated for them.
+static uint64_t bytesBeforeEndSignature(std::ifstream& infile) {
+    std::streamoff position = infile.tellg();
+    infile.seekg(0, std::ios::end);
+    std::streamoff file_end = infile.tellg();
+    infile.seekg(position);
+    if (!infile) {
+        return 0;
+    }
+    return static_cast<uint64_t>(std::max<std::streamoff>(file_end - position - 10, 0));
+}
 
 UncompressedImage::UncompressedImage()
     : width(0), height(0), is_grayscale(false), image_data() {}
 
 UncompressedImage::UncompressedImage(uint32_t w, uint32_t h, bool gray)
     : width(w), height(h), is_grayscale(gray),
-      image_data(h, std::vector<ColorRGB>(w, ColorRGB{0, 0, 0})) {}
+      image_data(w, h, ColorRGB{0, 0, 0}) {}
 
 uint32_t UncompressedImage::getWidth() const { return width; }
 uint32_t UncompressedImage::getHeight() const { return height; }
 bool UncompressedImage::getIsGrayscale() const { return is_grayscale; }
-const std::vector<std::vector<ColorRGB>>& UncompressedImage::getImageData() const { return image_data; }
+bool UncompressedImage::hasGrayStorage() const { return !gray_data.empty(); }
+const ImagePlane<ColorRGB>& UncompressedImage::getImageData() const { return image_data; }
+const ImagePlane<uint8_t>& UncompressedImage::getGrayData() const { return gray_data; }
+ImagePlane<ColorRGB>& UncompressedImage::getMutableImageData() { return image_data; }
+ImagePlane<uint8_t>& UncompressedImage::getMutableGrayData() { return gray_data; }
+std::span<ColorRGB> UncompressedImage::getMutableRow(uint32_t y) { return image_data[y]; }
+std::span<uint8_t> UncompressedImage::getMutableGrayRow(uint32_t y) { return gray_data[y]; }
+
+ImagePlane<ColorRGB> UncompressedImage::takeImageData() {
+    return std::exchange(image_data, {});
+}
+
+ImagePlane<uint8_t> UncompressedImage::takeGrayData() {
+    return std::exchange(gray_data, {});
+}
+
+ColorRGB UncompressedImage::getPixel(uint32_t x, uint32_t y) const {
+    if (x >= width || y >= height) {
+        handleLogMessage("Попытка доступа к пикселю вне границ изображения.", Severity::WARNING);
+        return ColorRGB{0, 0, 0};
+    }
+    if (hasGrayStorage()) {
+        uint8_t gray = gray_data[y][x];
+        return ColorRGB{gray, gray, gray};
+    }
+    return image_data[y][x];
+}
 
 void UncompressedImage::setWidth(uint32_t w) { width = w; }
 void UncompressedImage::setHeight(uint32_t h) { height = h; }
-void UncompressedImage::setIsGrayscale(bool gray) { is_grayscale = gray; }
-void UncompressedImage::setImageData(const std::vector<std::vector<ColorRGB>>& data) { image_data = data; }
+
+void UncompressedImage::setIsGrayscale(bool gray) {
+    if (!gray) {
+        expandGrayscale();
+    }
+    is_grayscale = gray;
+}
+
+void UncompressedImage::setImageData(const ImagePlane<ColorRGB>& data) {
+    image_data = data;
+    gray_data.clear();
+}
+
+void UncompressedImage::setImageData(ImagePlane<ColorRGB>&& data) {
+    image_data = std::move(data);
+    gray_data.clear();
+}
+
+void UncompressedImage::setGrayData(const ImagePlane<uint8_t>& data) {
+    gray_data = data;
+    image_data.clear();
+    is_grayscale = true;
+}
+
+void UncompressedImage::setGrayData(ImagePlane<uint8_t>&& data) {
+    gray_data = std::move(data);
+    image_data.clear();
+    is_grayscale = true;
+}
 
 void UncompressedImage::setPixel(uint32_t x, uint32_t y, const ColorRGB& color) {
     if (x >= width || y >= height) {
         handleLogMessage("Попытка доступа к пикселю вне границ изображения.", Severity::WARNING);
         return;
     }
+    if (hasGrayStorage()) {
+        gray_data[y][x] = colorToGrayscale(color);
+        return;
+    }
     image_data[y][x] = color;
 }
 
-bool UncompressedImage::readFromFile(const std::string& filename) {
+void UncompressedImage::compactGrayscale() {
+    if (!is_grayscale || hasGrayStorage() || image_data.empty()) {
+        return;
+    }
+    ImagePlane<uint8_t> gray(width, height);
+    std::transform(image_data.data(), image_data.data() + image_data.pixelCount(), gray.data(),
+                   [](const ColorRGB& color) { return color.r; });
+    gray_data = std::move(gray);
+    image_data.clear();
+}
+
+void UncompressedImage::expandGrayscale() {
+    if (!hasGrayStorage()) {
+        return;
+    }
+    ImagePlane<ColorRGB> colors(width, height);
+    std::transform(gray_data.data(), gray_data.data() + gray_data.pixelCount(), colors.data(),
+                   [](uint8_t gray) { return ColorRGB{gray, gray, gray}; });
+    image_data = std::move(colors);
+    gray_data.clear();
+}
+
+bool UncompressedImage::readFromFile(const std::string& filename, bool compact_grayscale) {
     std::ifstream infile(filename, std::ios::binary);
     if (!infile) {
         handleLogMessage("Не удалось открыть файл для чтения: " + filename, Severity::ERROR);
@@ -38,13 +134,14 @@ bool UncompressedImage::readFromFile(const std::string& filename) {
 
     char format[10];
     infile.read(format, 10);
-    if (std::string(format, 10) != "RAWIMAGE\0") {
+    if (std::memcmp(format, "RAWIMAGE\0", 10) != 0) {
         handleLogMessage("Неверный формат файла: " + filename, Severity::ERROR);
         return false;
     }
     unsigned char version[3];
     infile.read(reinterpret_cast<char*>(version), 3);
-    if (version[0] != 1 || version[1] != 0 || version[2] != 0) {
+    bool delta_coding = version[0] == 2 && version[1] == 0 && version[2] == 0;
+    if (!delta_coding && (version[0] != 1 || version[1] != 0 || version[2] != 0)) {
         handleLogMessage("Неверная версия формата файла: " + filename, Severity::ERROR);
         return false;
     }
@@ -56,9 +153,43 @@ bool UncompressedImage::readFromFile(const std::string& filename) {
     infile.read(reinterpret_cast<char*>(&gray_flag), 1);
     is_grayscale = (gray_flag == 1);
 
-    image_data.assign(height, std::vector<ColorRGB>(width, ColorRGB{0, 0, 0}));
+    if (delta_coding) {
+        unsigned char coding_flags;
+        uint64_t payload_size;
+        infile.read(reinterpret_cast<char*>(&coding_flags), 1);
+        infile.read(reinterpret_cast<char*>(&payload_size), 8);
+
+        if (!infile || payload_size > bytesBeforeEndSignature(infile)) {
+            handleLogMessage("Некорректный размер данных пикселей в файле: " + filename, Severity::ERROR);
+            return false;
+        }
 
-    if (is_grayscale) {
+        std::vector<uint8_t> payload(payload_size);
+        infile.read(reinterpret_cast<char*>(payload.data()), payload_size);
+        bool decoded = infile.gcount() == static_cast<std::streamsize>(payload_size);
+        if (decoded && is_grayscale && compact_grayscale) {
+            image_data.clear();
+            decoded = decodeDeltaGrayImage(payload, width, height, gray_data);
+        } else if (decoded) {
+            gray_data.clear();
+            decoded = decodeDeltaImage(
+                payload, width, height, is_grayscale, coding_flags & 1, image_data);
+        }
+        if (!decoded) {
+            handleLogMessage("Некорректные данные пикселей в файле: " + filename, Severity::ERROR);
+            return false;
+        }
+    } else if (static_cast<uint64_t>(width) * height * (is_grayscale ? 1 : 3)
+               > bytesBeforeEndSignature(infile)) {
+        handleLogMessage("Некорректный размер данных пикселей в файле: " + filename, Severity::ERROR);
+        return false;
+    } else if (is_grayscale && compact_grayscale) {
+        image_data.clear();
+        gray_data = ImagePlane<uint8_t>(width, height, 0);
+        infile.read(reinterpret_cast<char*>(gray_data.data()), gray_data.pixelCount());
+    } else if (is_grayscale) {
+        gray_data.clear();
+        image_data = ImagePlane<ColorRGB>(width, height, ColorRGB{0, 0, 0});
         for (uint32_t y = 0; y < height; ++y) {
             for (uint32_t x = 0; x < width; ++x) {
                 uint8_t gray;
@@ -67,6 +198,8 @@ bool UncompressedImage::readFromFile(const std::string& filename) {
             }
         }
     } else {
+        gray_data.clear();
+        image_data = ImagePlane<ColorRGB>(width, height, ColorRGB{0, 0, 0});
         for (uint32_t y = 0; y < height; ++y) {
             for (uint32_t x = 0; x < width; ++x) {
                 ColorRGB color = readFromFileStream(infile);
@@ -77,27 +210,30 @@ bool UncompressedImage::readFromFile(const std::string& filename) {
 
     char end[10];
     infile.read(end, 10);
-    if (std::string(end, 10) != "RAWIMGEND\0") {
+    if (std::memcmp(end, "RAWIMGEND\0", 10) != 0) {
         handleLogMessage("Отсутствует завершающая подпись в файле: " + filename, Severity::ERROR);
         return false;
     }
 
     infile.close();
-    handleLogMessage("Файл успешно прочитан: " + filename, Severity::INFO);
+    LOG_INFO("Файл успешно прочитан: ", filename);
     return true;
 }
 
-bool UncompressedImage::writeToFile(const std::string& filename) const {
+bool UncompressedImage::writeToFile(const std::string& filename, bool delta_coding) const {
     std::ofstream outfile(filename, std::ios::binary);
     if (!outfile) {
         handleLogMessage("Не удалось открыть файл для записи: " + filename, Severity::ERROR);
         return false;
     }
 
-    char format[10] = "RAWIMAGE\0";
+    char format[] = "RAWIMAGE\0";
     outfile.write(format, 10);
 
     unsigned char version[3] = {1, 0, 0};
+    if (delta_coding) {
+        version[0] = 2;
+    }
     outfile.write(reinterpret_cast<const char*>(version), 3);
 
     outfile.write(reinterpret_cast<const char*>(&width), 4);
@@ -106,7 +242,22 @@ bool UncompressedImage::writeToFile(const std::string& filename) const {
     unsigned char gray_flag = is_grayscale ? 1 : 0;
     outfile.write(reinterpret_cast<const char*>(&gray_flag), 1);
 
-    if (is_grayscale) {
+    if (delta_coding) {
+        unsigned char coding_flags = is_grayscale ? 0 : 1;
+        outfile.write(reinterpret_cast<const char*>(&coding_flags), 1);
+
+        std::vector<uint8_t> payload =
+            hasGrayStorage()
+                ? encodeDeltaGrayImage(gray_data, width, height)
+                : encodeDeltaImage(image_data, width, height, is_grayscale, coding_flags & 1);
+        uint64_t payload_size = payload.size();
+        outfile.write(reinterpret_cast<const char*>(&payload_size), 8);
+        outfile.write(reinterpret_cast<const char*>(payload.data()), payload_size);
+    } else if (hasGrayStorage()) {
+        for (const auto& row : gray_data) {
+            outfile.write(reinterpret_cast<const char*>(row.data()), row.size());
+        }
+    } else if (is_grayscale) {
         for (const auto& row : image_data) {
             for (const auto& pixel : row) {
                 uint8_t gray = pixel.r; 
@@ -123,11 +274,15 @@ bool UncompressedImage::writeToFile(const std::string& filename) const {
         }
     }
 
-    char end[10] = "RAWIMGEND\0";
+    char end[] = "RAWIMGEND\0";
     outfile.write(end, 10);
 
     outfile.close();
-    handleLogMessage("Файл успешно записан: " + filename, Severity::INFO);
+    if (outfile.fail()) {
+        handleLogMessage("Ошибка записи в файл: " + filename, Severity::ERROR);
+        return false;
+    }
+    LOG_INFO("Файл успешно записан: ", filename);
     return true;
 }
 
@@ -136,19 +291,28 @@ CompressedImage::CompressedImage()
 
 CompressedImage::CompressedImage(uint32_t w, uint32_t h)
     : width(w), height(h), id_to_color(), color_to_id(),
-      image_data(h, std::vector<uint8_t>(w, 0)) {}
+      image_data(w, h, 0) {}
 
 uint32_t CompressedImage::getWidth() const { return width; }
 uint32_t CompressedImage::getHeight() const { return height; }
 const std::map<uint8_t, ColorRGB>& CompressedImage::getIdToColor() const { return id_to_color; }
 const std::unordered_map<ColorRGB, uint8_t, ColorHash>& CompressedImage::getColorToId() const { return color_to_id; }
-const std::vector<std::vector<uint8_t>>& CompressedImage::getImageData() const { return image_data; }
+const ImagePlane<uint8_t>& CompressedImage::getImageData() const { return image_data; }
+ImagePlane<uint8_t>& CompressedImage::getMutableImageData() { return image_data; }
+std::span<uint8_t> CompressedImage::getMutableRow(uint32_t y) { return image_data[y]; }
+
+ImagePlane<uint8_t> CompressedImage::takeImageData() {
+    return std::exchange(image_data, {});
+}
 
 void CompressedImage::setWidth(uint32_t w) { width = w; }
 void CompressedImage::setHeight(uint32_t h) { height = h; }
 void CompressedImage::setIdToColor(const std::map<uint8_t, ColorRGB>& table) { id_to_color = table; }
 void CompressedImage::setColorToId(const std::unordered_map<ColorRGB, uint8_t, ColorHash>& table) { color_to_id = table; }
-void CompressedImage::setImageData(const std::vector<std::vector<uint8_t>>& data) { image_data = data; }
+void CompressedImage::setImageData(const ImagePlane<uint8_t>& data) { image_data = data; }
+void CompressedImage::setIdToColor(std::map<uint8_t, ColorRGB>&& table) { id_to_color = std::move(table); }
+void CompressedImage::setColorToId(std::unordered_map<ColorRGB, uint8_t, ColorHash>&& table) { color_to_id = std::move(table); }
+void CompressedImage::setImageData(ImagePlane<uint8_t>&& data) { image_data = std::move(data); }
 
 void CompressedImage::setPixel(uint32_t x, uint32_t y, uint8_t color_id) {
     if (x >= width || y >= height) {
@@ -167,7 +331,7 @@ bool CompressedImage::readFromFile(const std::string& filename) {
 
     char format[10];
     infile.read(format, 10);
-    if (std::string(format, 10) != "CMPRIMAGE\0") {
+    if (std::memcmp(format, "CMPRIMAGE\0", 10) != 0) {
         handleLogMessage("Неверный формат файла: " + filename, Severity::ERROR);
         return false;
     }
@@ -183,7 +347,7 @@ bool CompressedImage::readFromFile(const std::string& filename) {
 
     unsigned char pow;
     infile.read(reinterpret_cast<char*>(&pow), 1);
-    size_t colorTableSize = std::pow(2, pow);
+    size_t colorTableSize = size_t{1} << std::min<unsigned>(pow, 8);
 
     id_to_color.clear();
     color_to_id.clear();
@@ -193,7 +357,11 @@ bool CompressedImage::readFromFile(const std::string& filename) {
         color_to_id[color] = static_cast<uint8_t>(i);
     }
 
-    image_data.assign(height, std::vector<uint8_t>(width, 0));
+    if (static_cast<uint64_t>(width) * height > bytesBeforeEndSignature(infile)) {
+        handleLogMessage("Некорректный размер данных пикселей в файле: " + filename, Severity::ERROR);
+        return false;
+    }
+    image_data = ImagePlane<uint8_t>(width, height, 0);
 
     for (uint32_t y = 0; y < height; ++y) {
         for (uint32_t x = 0; x < width; ++x) {
@@ -209,13 +377,13 @@ bool CompressedImage::readFromFile(const std::string& filename) {
 
     char end[10];
     infile.read(end, 10);
-    if (std::string(end, 10) != "CMPRIMGEND\0") {
+    if (std::memcmp(end, "CMPRIMGEND\0", 10) != 0) {
         handleLogMessage("Отсутствует завершающая подпись в файле: " + filename, Severity::ERROR);
         return false;
     }
 
     infile.close();
-    handleLogMessage("Файл успешно прочитан: " + filename, Severity::INFO);
+    LOG_INFO("Файл успешно прочитан: ", filename);
     return true;
 }
 
@@ -226,7 +394,7 @@ bool CompressedImage::writeToFile(const std::string& filename) const {
         return false;
     }
 
-    char format[10] = "CMPRIMAGE\0";
+    char format[] = "CMPRIMAGE\0";
     outfile.write(format, 10);
 
     unsigned char version[3] = {6, 6, 6};
@@ -237,7 +405,7 @@ bool CompressedImage::writeToFile(const std::string& filename) const {
 
     size_t colorTableSize = id_to_color.size();
     unsigned char pow = 0;
-    while (std::pow(2, pow) < colorTableSize) {
+    while ((size_t{1} << pow) < colorTableSize) {
         pow++;
     }
     outfile.write(reinterpret_cast<const char*>(&pow), 1);
@@ -247,6 +415,11 @@ bool CompressedImage::writeToFile(const std::string& filename) const {
         outfile.write(reinterpret_cast<const char*>(&color.g), 1);
         outfile.write(reinterpret_cast<const char*>(&color.b), 1);
     }
+    // Readers take 2^pow colors by position, so a shorter palette is padded with black.
+    const char padding[3] = {0, 0, 0};
+    for (size_t i = colorTableSize; i < (size_t{1} << pow); ++i) {
+        outfile.write(padding, 3);
+    }
 
     for (const auto& row : image_data) {
         for (const auto& color_id : row) {
@@ -254,11 +427,15 @@ bool CompressedImage::writeToFile(const std::string& filename) const {
         }
     }
 
-    char end[10] = "CMPRIMGEND\0";
+    char end[] = "CMPRIMGEND\0";
     outfile.write(end, 10);
 
     outfile.close();
-    handleLogMessage("Файл успешно записан: " + filename, Severity::INFO);
+    if (outfile.fail()) {
+        handleLogMessage("Ошибка записи в файл: " + filename, Severity::ERROR);
+        return false;
+    }
+    LOG_INFO("Файл успешно записан: ", filename);
     return true;
 }
 
@@ -282,8 +459,8 @@ bool matchUncompressedImages(const UncompressedImage& img1, const UncompressedIm
 
     for (uint32_t y = 0; y < img1.getHeight(); ++y) {
         for (uint32_t x = 0; x < img1.getWidth(); ++x) {
-            const ColorRGB& color1 = img1.getImageData()[y][x];
-            const ColorRGB& color2 = img2.getImageData()[y][x];
+            ColorRGB color1 = img1.getPixel(x, y);
+            ColorRGB color2 = img2.getPixel(x, y);
             if (color1 != color2) {
                 if (verbose) {
                     std::cerr << "Несоответствие пикселей на координатах (" << y << ", " << x << "): ";
@@ -85,6 +85,7 @@ void BMP::read(const char* fname) {
 
     data.resize(row_stride * bmp_info_header.height, 0);
 
+    inp.seekg(file_header.offset_data, std::ios_base::beg);
     for (int y = 0; y < bmp_info_header.height; ++y) {
         int read_y = is_bottom_up ? (bmp_info_header.height - 1 - y) : y;
         inp.read(reinterpret_cast<char*>(data.data() + read_y * row_stride), row_stride);
@@ -2,6 +2,7 @@
 #include "images.h"
 #include "image_transforms.h"
 #include "libbmp.h"
+#include "metrics.h"
 #include <iostream>
 #include <exception>
 #include <unordered_map>
@@ -36,6 +37,7 @@ BMP convertUncompressedToBMP(const UncompressedImage& img) {
 
 int main() {
     openLogFile("log.txt", true);
+    exportMetricsOnExit("metrics.json", MetricsFormat::JSON);
 
     try {
         BMP bmp_loader("images/sample.bmp");
@@ -101,7 +103,7 @@ int main() {
                 compressed_data[y][x] = id;
             }
         }
-        cImg.setImageData(compressed_data);
+        cImg.setImageData(std::move(compressed_data));
         handleLogMessage("UncompressedImage конвертировано в CompressedImage.", Severity::INFO);
 
         mirror(cImg, true);
@@ -0,0 +1,190 @@
+#include "metrics.h"
+#include "error_handlers.h"
+#include <bit>
+#include <cstdlib>
+#include <fstream>
+
+StageMetrics::StageMetrics(std::string name) : name(std::move(name)) {}
+
+size_t StageMetrics::bucketIndex(uint64_t nanoseconds) {
+    if (nanoseconds < SUB_BUCKETS) {
+        return nanoseconds;
+    }
+    size_t exponent = std::bit_width(nanoseconds) - 1;
+    size_t sub_bucket = (nanoseconds >> (exponent - 3)) & (SUB_BUCKETS - 1);
+    return std::min((exponent - 2) * SUB_BUCKETS + sub_bucket, BUCKET_COUNT - 1);
+}
+
+double StageMetrics::bucketMidpoint(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    size_t exponent = index / SUB_BUCKETS + 2;
+    size_t sub_bucket = index % SUB_BUCKETS;
+    double width = static_cast<double>(uint64_t{1} << (exponent - 3));
+    return (SUB_BUCKETS + sub_bucket) * width + width / 2;
+}
+
+void StageMetrics::record(uint64_t nanoseconds, uint64_t pixels, uint64_t bytes) {
+    count.fetch_add(1, std::memory_order_relaxed);
+    total_nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    total_pixels.fetch_add(pixels, std::memory_order_relaxed);
+    total_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    buckets[bucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+}
+
+double StageMetrics::quantile(double q, uint64_t count) const {
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * count + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return bucketMidpoint(i) * 1e-9;
+        }
+    }
+    return bucketMidpoint(BUCKET_COUNT - 1) * 1e-9;
+}
+
+StageStats StageMetrics::stats() const {
+    StageStats result;
+    result.name = name;
+    result.count = count.load(std::memory_order_relaxed);
+    result.total_seconds = total_nanoseconds.load(std::memory_order_relaxed) * 1e-9;
+    result.pixels = total_pixels.load(std::memory_order_relaxed);
+    result.bytes = total_bytes.load(std::memory_order_relaxed);
+    if (result.count > 0) {
+        result.p50_seconds = quantile(0.5, result.count);
+        result.p99_seconds = quantile(0.99, result.count);
+    }
+    if (result.total_seconds > 0) {
+        result.megapixels_per_second = result.pixels / result.total_seconds * 1e-6;
+    }
+    return result;
+}
+
+void StageMetrics::reset() {
+    count = 0;
+    total_nanoseconds = 0;
+    total_pixels = 0;
+    total_bytes = 0;
+    for (auto& bucket : buckets) {
+        bucket = 0;
+    }
+}
+
+MetricsRegistry& MetricsRegistry::instance() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+StageMetrics& MetricsRegistry::stage(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& stage = stages[name];
+    if (!stage) {
+        stage = std::make_unique<StageMetrics>(name);
+    }
+    return *stage;
+}
+
+std::vector<StageStats> MetricsRegistry::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<StageStats> result;
+    for (const auto& [name, stage] : stages) {
+        result.push_back(stage->stats());
+    }
+    return result;
+}
+
+void MetricsRegistry::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& [name, stage] : stages) {
+        stage->reset();
+    }
+}
+
+void MetricsRegistry::exportJSON(std::ostream& out) const {
+    std::vector<StageStats> stats = snapshot();
+    out << "{\n  \"stages\": [";
+    for (size_t i = 0; i < stats.size(); ++i) {
+        const StageStats& stage = stats[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << stage.name
+            << "\", \"count\": " << stage.count << ", \"p50_seconds\": " << stage.p50_seconds
+            << ", \"p99_seconds\": " << stage.p99_seconds
+            << ", \"total_seconds\": " << stage.total_seconds << ", \"bytes\": " << stage.bytes
+            << ", \"pixels\": " << stage.pixels
+            << ", \"megapixels_per_second\": " << stage.megapixels_per_second << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void MetricsRegistry::exportPrometheus(std::ostream& out) const {
+    std::vector<StageStats> stats = snapshot();
+    out << "# TYPE image_compressor_stage_seconds summary\n";
+    for (const StageStats& stage : stats) {
+        std::string label = "stage=\"" + stage.name + "\"";
+        out << "image_compressor_stage_seconds{" << label << ",quantile=\"0.5\"} "
+            << stage.p50_seconds << "\n"
+            << "image_compressor_stage_seconds{" << label << ",quantile=\"0.99\"} "
+            << stage.p99_seconds << "\n"
+            << "image_compressor_stage_seconds_sum{" << label << "} " << stage.total_seconds
+            << "\n"
+            << "image_compressor_stage_seconds_count{" << label << "} " << stage.count << "\n";
+    }
+    out << "# TYPE image_compressor_stage_bytes_total counter\n";
+    for (const StageStats& stage : stats) {
+        out << "image_compressor_stage_bytes_total{stage=\"" << stage.name << "\"} "
+            << stage.bytes << "\n";
+    }
+    out << "# TYPE image_compressor_stage_megapixels_per_second gauge\n";
+    for (const StageStats& stage : stats) {
+        out << "image_compressor_stage_megapixels_per_second{stage=\"" << stage.name << "\"} "
+            << stage.megapixels_per_second << "\n";
+    }
+}
+
+bool MetricsRegistry::exportToFile(const std::string& filename, MetricsFormat format) const {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        handleLogMessage("Не удалось открыть файл метрик: " + filename, Severity::ERROR);
+        return false;
+    }
+    if (format == MetricsFormat::JSON) {
+        exportJSON(file);
+    } else {
+        exportPrometheus(file);
+    }
+    return true;
+}
+
+static std::string metrics_exit_filename;
+static MetricsFormat metrics_exit_format = MetricsFormat::JSON;
+
+static void exportMetricsAtExit() {
+    MetricsRegistry::instance().exportToFile(metrics_exit_filename, metrics_exit_format);
+}
+
+void exportMetricsOnExit(const std::string& filename, MetricsFormat format) {
+    bool registered = !metrics_exit_filename.empty();
+    metrics_exit_filename = filename;
+    metrics_exit_format = format;
+    if (!registered) {
+        // Touch the registry first so it is destroyed only after the handler has run.
+        MetricsRegistry::instance();
+        std::atexit(exportMetricsAtExit);
+    }
+}
+
+ScopedTimer::ScopedTimer(StageMetrics& stage, uint64_t pixels, uint64_t bytes)
+    : stage(stage), pixels(pixels), bytes(bytes), start(std::chrono::steady_clock::now()) {
+}
+
+ScopedTimer::~ScopedTimer() {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    stage.record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), pixels, bytes);
+}
+
+void ScopedTimer::setWork(uint64_t pixels, uint64_t bytes) {
+    this->pixels = pixels;
+    this->bytes = bytes;
+}
@@ -0,0 +1,258 @@
+#include "palette_lut.h"
+#include "buffer_pool.h"
+#include "error_handlers.h"
+#include "metrics.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+static constexpr char LUT_SIGNATURE[10] = "CMPRPALUT";
+// The table starts on a page boundary, so a mapped file is used as is.
+static constexpr size_t LUT_TABLE_OFFSET = 4096;
+// Side of the cubic cells that share one candidate list during the build.
+static constexpr int CELL_SIZE = 8;
+static constexpr int CELLS_PER_AXIS = 256 / CELL_SIZE;
+// Palettes whose pixel counts are tracked before their counts are dropped.
+static constexpr size_t MAX_PENDING_PALETTES = 64;
+
+PaletteLUT::PaletteLUT(const std::map<uint8_t, ColorRGB>& palette) : palette(palette) {}
+
+PaletteLUT::~PaletteLUT() {
+    if (pooled != nullptr) {
+        BufferPool::instance().deallocate(pooled, ENTRY_COUNT);
+    }
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_size);
+    }
+}
+
+// Squared distances from a channel value to the nearest and to the farthest value of a cell.
+static void axisDistances(int value, int cell_start, int& nearest, int& farthest) {
+    int cell_end = cell_start + CELL_SIZE - 1;
+    int near = value < cell_start ? cell_start - value : (value > cell_end ? value - cell_end : 0);
+    int far = std::max(std::abs(value - cell_start), std::abs(value - cell_end));
+    nearest = near * near;
+    farthest = far * far;
+}
+
+// Fills the entries of one cell. Only palette colors that may be the nearest one for some color
+// of the cell are searched: a color whose distance to the cell exceeds the largest distance from
+// the cell to another palette color is strictly farther for every point, so it can neither win
+// nor tie. Candidates keep ascending id order, which keeps findClosestColorId's tie-breaking.
+static void fillCell(const std::vector<std::pair<uint8_t, ColorRGB>>& entries, int r0, int g0, int b0,
+                     uint8_t* ids, std::vector<size_t>& candidates) {
+    std::vector<int> nearest(entries.size());
+    int bound = std::numeric_limits<int>::max();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const ColorRGB& color = entries[i].second;
+        int nr, ng, nb, fr, fg, fb;
+        axisDistances(color.r, r0, nr, fr);
+        axisDistances(color.g, g0, ng, fg);
+        axisDistances(color.b, b0, nb, fb);
+        nearest[i] = nr + ng + nb;
+        bound = std::min(bound, fr + fg + fb);
+    }
+    candidates.clear();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (nearest[i] <= bound) {
+            candidates.push_back(i);
+        }
+    }
+
+    for (int r = r0; r < r0 + CELL_SIZE; ++r) {
+        for (int g = g0; g < g0 + CELL_SIZE; ++g) {
+            uint8_t* row = ids + ((r << 16) | (g << 8));
+            for (int b = b0; b < b0 + CELL_SIZE; ++b) {
+                int best_distance = std::numeric_limits<int>::max();
+                uint8_t best_id = 0;
+                for (size_t i : candidates) {
+                    const ColorRGB& color = entries[i].second;
+                    int dr = r - color.r, dg = g - color.g, db = b - color.b;
+                    int distance = dr * dr + dg * dg + db * db;
+                    if (distance < best_distance) {
+                        best_distance = distance;
+                        best_id = entries[i].first;
+                    }
+                }
+                row[b] = best_id;
+            }
+        }
+    }
+}
+
+std::shared_ptr<const PaletteLUT> PaletteLUT::build(
+    const std::map<uint8_t, ColorRGB>& palette, size_t threads) {
+    STAGE_TIMER(timer, "PaletteLUT::build", ENTRY_COUNT, ENTRY_COUNT);
+    std::shared_ptr<PaletteLUT> table(new PaletteLUT(palette));
+    table->pooled = static_cast<uint8_t*>(BufferPool::instance().allocate(ENTRY_COUNT));
+    table->ids = table->pooled;
+    if (palette.empty()) {
+        handleLogMessage("Таблица цветов пуста.", Severity::WARNING);
+        std::memset(table->pooled, 0, ENTRY_COUNT);
+        return table;
+    }
+
+    std::vector<std::pair<uint8_t, ColorRGB>> entries(palette.begin(), palette.end());
+    // Bands of red cells are contiguous in the table and are first touched by their own thread.
+    parallelForBands(CELLS_PER_AXIS, 1, [&](size_t begin, size_t end) {
+        std::vector<size_t> candidates;
+        for (size_t cell_r = begin; cell_r < end; ++cell_r) {
+            for (int cell_g = 0; cell_g < CELLS_PER_AXIS; ++cell_g) {
+                for (int cell_b = 0; cell_b < CELLS_PER_AXIS; ++cell_b) {
+                    fillCell(entries, cell_r * CELL_SIZE, cell_g * CELL_SIZE, cell_b * CELL_SIZE,
+                             table->pooled, candidates);
+                }
+            }
+        }
+    }, threads);
+    LOG_INFO("Построена таблица ближайших цветов для палитры из ", palette.size(), " цветов.");
+    return table;
+}
+
+bool PaletteLUT::save(const std::string& filename) const {
+    std::ofstream outfile(filename, std::ios::binary);
+    if (!outfile) {
+        handleLogMessage("Не удалось открыть файл таблицы цветов для записи: " + filename, Severity::ERROR);
+        return false;
+    }
+
+    std::vector<char> header(LUT_TABLE_OFFSET, 0);
+    std::memcpy(header.data(), LUT_SIGNATURE, sizeof(LUT_SIGNATURE));
+    uint32_t palette_size = palette.size();
+    std::memcpy(header.data() + sizeof(LUT_SIGNATURE), &palette_size, 4);
+    char* entry = header.data() + sizeof(LUT_SIGNATURE) + 4;
+    for (const auto& [id, color] : palette) {
+        entry[0] = id;
+        entry[1] = color.r;
+        entry[2] = color.g;
+        entry[3] = color.b;
+        entry += 4;
+    }
+    outfile.write(header.data(), header.size());
+    outfile.write(reinterpret_cast<const char*>(ids), ENTRY_COUNT);
+    return outfile.good();
+}
+
+std::shared_ptr<const PaletteLUT> PaletteLUT::load(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        handleLogMessage("Не удалось открыть файл таблицы цветов: " + filename, Severity::ERROR);
+        return nullptr;
+    }
+    struct stat file_stat;
+    size_t file_size = fstat(fd, &file_stat) == 0 ? file_stat.st_size : 0;
+    // MAP_SHARED keeps a single copy in the page cache for every process using the file.
+    void* mapping = file_size == LUT_TABLE_OFFSET + ENTRY_COUNT
+        ? mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        handleLogMessage("Некорректный файл таблицы цветов: " + filename, Severity::ERROR);
+        return nullptr;
+    }
+
+    const char* header = static_cast<const char*>(mapping);
+    uint32_t palette_size = 0;
+    std::memcpy(&palette_size, header + sizeof(LUT_SIGNATURE), 4);
+    if (std::memcmp(header, LUT_SIGNATURE, sizeof(LUT_SIGNATURE)) != 0 || palette_size > 256) {
+        munmap(mapping, file_size);
+        handleLogMessage("Некорректный файл таблицы цветов: " + filename, Severity::ERROR);
+        return nullptr;
+    }
+    std::map<uint8_t, ColorRGB> palette;
+    const uint8_t* entry = reinterpret_cast<const uint8_t*>(header + sizeof(LUT_SIGNATURE) + 4);
+    for (uint32_t i = 0; i < palette_size; ++i, entry += 4) {
+        palette[entry[0]] = ColorRGB{entry[1], entry[2], entry[3]};
+    }
+
+    std::shared_ptr<PaletteLUT> table(new PaletteLUT(palette));
+    table->mapping = mapping;
+    table->mapping_size = file_size;
+    table->ids = static_cast<const uint8_t*>(mapping) + LUT_TABLE_OFFSET;
+    madvise(mapping, file_size, MADV_WILLNEED);
+    return table;
+}
+
+struct SharedTables {
+    std::mutex mutex;
+    // Most recently used last.
+    std::vector<std::shared_ptr<const PaletteLUT>> tables;
+    // Pixels converted so far with palettes that have no table yet.
+    std::unordered_map<std::string, uint64_t> pending_pixels;
+};
+
+static SharedTables& sharedTables() {
+    static SharedTables* shared = new SharedTables();
+    return *shared;
+}
+
+static std::string paletteKey(const std::map<uint8_t, ColorRGB>& palette) {
+    std::string key;
+    key.reserve(palette.size() * 4);
+    for (const auto& [id, color] : palette) {
+        key += static_cast<char>(id);
+        key += static_cast<char>(color.r);
+        key += static_cast<char>(color.g);
+        key += static_cast<char>(color.b);
+    }
+    return key;
+}
+
+static void insertShared(SharedTables& shared, std::shared_ptr<const PaletteLUT> table) {
+    auto& tables = shared.tables;
+    tables.erase(std::remove_if(tables.begin(), tables.end(), [&](const auto& cached) {
+        return cached->getPalette() == table->getPalette();
+    }), tables.end());
+    if (tables.size() == PaletteLUT::MAX_SHARED_TABLES) {
+        tables.erase(tables.begin());
+    }
+    tables.push_back(std::move(table));
+}
+
+std::shared_ptr<const PaletteLUT> PaletteLUT::acquire(
+    const std::map<uint8_t, ColorRGB>& palette, uint64_t pixel_count) {
+    SharedTables& shared = sharedTables();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    for (auto it = shared.tables.begin(); it != shared.tables.end(); ++it) {
+        if ((*it)->getPalette() == palette) {
+            std::rotate(it, it + 1, shared.tables.end());
+            return shared.tables.back();
+        }
+    }
+
+    std::string key = paletteKey(palette);
+    if (shared.pending_pixels.size() >= MAX_PENDING_PALETTES && shared.pending_pixels.count(key) == 0) {
+        shared.pending_pixels.clear();
+    }
+    uint64_t& pending = shared.pending_pixels[key];
+    pending += pixel_count;
+    if (pending < BUILD_THRESHOLD_PIXELS) {
+        return nullptr;
+    }
+    shared.pending_pixels.erase(key);
+    // Built under the lock: concurrent conversions with the same palette wait for this table
+    // instead of building their own.
+    insertShared(shared, build(palette));
+    return shared.tables.back();
+}
+
+void PaletteLUT::share(std::shared_ptr<const PaletteLUT> table) {
+    SharedTables& shared = sharedTables();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    insertShared(shared, std::move(table));
+}
+
+void PaletteLUT::clearShared() {
+    SharedTables& shared = sharedTables();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.tables.clear();
+    shared.pending_pixels.clear();
+}
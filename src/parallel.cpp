@@ -0,0 +1,41 @@
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static std::atomic<size_t> default_worker_threads{0};
+
+void setDefaultWorkerThreads(size_t threads) {
+    default_worker_threads = threads;
+}
+
+size_t defaultWorkerThreads() {
+    size_t threads = default_worker_threads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return threads;
+}
+
+void parallelForBands(size_t count, size_t min_band, const std::function<void(size_t, size_t)>& fn,
+                      size_t threads) {
+    if (threads == 0) {
+        threads = defaultWorkerThreads();
+    }
+    size_t bands = std::min(threads, count / std::max<size_t>(min_band, 1));
+    if (bands <= 1) {
+        fn(0, count);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(bands - 1);
+    for (size_t band = 1; band < bands; ++band) {
+        workers.emplace_back(fn, count * band / bands, count * (band + 1) / bands);
+    }
+    fn(0, count / bands);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
@@ -0,0 +1,534 @@
+#include "pipeline.h"
+#include "error_handlers.h"
+#include "image_transforms.h"
+#include "metrics.h"
+#include <algorithm>
+#include <memory>
+
+using Row = std::vector<ColorRGB>;
+using Kernel = std::vector<std::vector<int>>;
+
+namespace {
+
+class RowStream {
+public:
+    RowStream(uint32_t width, uint32_t height) : width(width), height(height) {}
+    virtual ~RowStream() = default;
+
+    // Rows are requested in increasing order; out has width pixels.
+    virtual void produce(uint32_t y, std::span<ColorRGB> out) = 0;
+
+    uint32_t width;
+    uint32_t height;
+};
+
+// Maps output coordinates back to the source: source_x = xx * x + xy * y + x0 and likewise for y.
+// Every composition of right-angle rotations and mirrors has this form.
+struct CoordinateMap {
+    int64_t xx = 1, xy = 0, x0 = 0;
+    int64_t yx = 0, yy = 1, y0 = 0;
+    uint32_t width;
+    uint32_t height;
+
+    CoordinateMap(uint32_t width, uint32_t height) : width(width), height(height) {}
+
+    bool isIdentity() const { return xx == 1 && xy == 0 && x0 == 0 && yx == 0 && yy == 1 && y0 == 0; }
+
+    // Clockwise, as rotate90 in image_transforms.cpp: output (x, y) shows input (y, height - 1 - x).
+    void rotate90() {
+        int64_t last_row = static_cast<int64_t>(height) - 1;
+        CoordinateMap previous = *this;
+        xx = -previous.xy;
+        xy = previous.xx;
+        x0 = previous.x0 + previous.xy * last_row;
+        yx = -previous.yy;
+        yy = previous.yx;
+        y0 = previous.y0 + previous.yy * last_row;
+        std::swap(width, height);
+    }
+
+    void mirror(bool horizontal) {
+        if (horizontal) {
+            int64_t last_column = static_cast<int64_t>(width) - 1;
+            x0 += xx * last_column;
+            xx = -xx;
+            y0 += yx * last_column;
+            yx = -yx;
+        } else {
+            int64_t last_row = static_cast<int64_t>(height) - 1;
+            x0 += xy * last_row;
+            xy = -xy;
+            y0 += yy * last_row;
+            yy = -yy;
+        }
+    }
+};
+
+class SourceStream : public RowStream {
+public:
+    SourceStream(const ImagePlane<ColorRGB>* color_rows, const ImagePlane<uint8_t>* gray_rows,
+                 const CoordinateMap& map)
+        : RowStream(map.width, map.height), color_rows(color_rows), gray_rows(gray_rows), map(map) {
+    }
+
+    void produce(uint32_t y, std::span<ColorRGB> out) override {
+        if (map.isIdentity() && color_rows != nullptr) {
+            std::copy((*color_rows)[y].begin(), (*color_rows)[y].end(), out.begin());
+            return;
+        }
+
+        int64_t source_x = map.xy * y + map.x0;
+        int64_t source_y = map.yy * y + map.y0;
+        for (uint32_t x = 0; x < width; ++x, source_x += map.xx, source_y += map.yx) {
+            if (color_rows != nullptr) {
+                out[x] = (*color_rows)[source_y][source_x];
+            } else {
+                uint8_t gray = (*gray_rows)[source_y][source_x];
+                out[x] = ColorRGB{gray, gray, gray};
+            }
+        }
+    }
+
+private:
+    const ImagePlane<ColorRGB>* color_rows;
+    const ImagePlane<uint8_t>* gray_rows;
+    CoordinateMap map;
+};
+
+enum class PointOperation { NEGATIVE, GRAYSCALE };
+
+// Applies consecutive negative and grayscale operations in one loop over each row.
+class PointStream : public RowStream {
+public:
+    explicit PointStream(std::unique_ptr<RowStream> upstream)
+        : RowStream(upstream->width, upstream->height), upstream(std::move(upstream)) {
+    }
+
+    void add(PointOperation operation) { operations.push_back(operation); }
+
+    void produce(uint32_t y, std::span<ColorRGB> out) override {
+        upstream->produce(y, out);
+        for (ColorRGB& color : out) {
+            for (PointOperation operation : operations) {
+                if (operation == PointOperation::NEGATIVE) {
+                    color = ColorRGB{static_cast<uint8_t>(255 - color.r),
+                                     static_cast<uint8_t>(255 - color.g),
+                                     static_cast<uint8_t>(255 - color.b)};
+                } else {
+                    uint8_t gray = colorToGrayscale(color);
+                    color = ColorRGB{gray, gray, gray};
+                }
+            }
+        }
+    }
+
+private:
+    std::unique_ptr<RowStream> upstream;
+    std::vector<PointOperation> operations;
+};
+
+// Keeps only the kernel-height window of upstream rows, each produced exactly once. The kernel is
+// anchored at (rows / 2, columns / 2), as in applyKernel.
+class KernelStream : public RowStream {
+public:
+    KernelStream(std::unique_ptr<RowStream> upstream, const std::vector<std::vector<int>>& kernel,
+                 int divisor)
+        : RowStream(upstream->width, upstream->height),
+          upstream(std::move(upstream)),
+          kernel(kernel),
+          divisor(divisor),
+          kernel_rows(kernel.size()),
+          kernel_columns(kernel[0].size()),
+          offset_y(kernel.size() / 2),
+          window(kernel.size(), Row(width)),
+          window_rows(kernel.size()) {
+        size_t offset_x = kernel_columns / 2;
+        columns.resize(width + kernel_columns - 1);
+        for (size_t i = 0; i < columns.size(); ++i) {
+            columns[i] = std::clamp<int64_t>(static_cast<int64_t>(i) - offset_x, 0, width - 1);
+        }
+    }
+
+    void produce(uint32_t y, std::span<ColorRGB> out) override {
+        uint32_t last_needed = std::min<uint64_t>(height - 1, static_cast<uint64_t>(y) + kernel_rows - 1 - offset_y);
+        for (; next_row <= last_needed; ++next_row) {
+            upstream->produce(next_row, window[next_row % kernel_rows]);
+        }
+        for (size_t ky = 0; ky < kernel_rows; ++ky) {
+            int64_t row = std::clamp<int64_t>(static_cast<int64_t>(y) + ky - offset_y, 0, height - 1);
+            window_rows[ky] = &window[row % kernel_rows];
+        }
+
+        for (uint32_t x = 0; x < width; ++x) {
+            int sum_r = 0, sum_g = 0, sum_b = 0;
+            for (size_t ky = 0; ky < kernel_rows; ++ky) {
+                const Row& row = *window_rows[ky];
+                const std::vector<int>& weights = kernel[ky];
+                for (size_t kx = 0; kx < kernel_columns; ++kx) {
+                    const ColorRGB& color = row[columns[x + kx]];
+                    sum_r += color.r * weights[kx];
+                    sum_g += color.g * weights[kx];
+                    sum_b += color.b * weights[kx];
+                }
+            }
+            out[x] = ColorRGB{static_cast<uint8_t>(std::clamp(sum_r / divisor, 0, 255)),
+                              static_cast<uint8_t>(std::clamp(sum_g / divisor, 0, 255)),
+                              static_cast<uint8_t>(std::clamp(sum_b / divisor, 0, 255))};
+        }
+    }
+
+private:
+    std::unique_ptr<RowStream> upstream;
+    std::vector<std::vector<int>> kernel;
+    int divisor;
+    size_t kernel_rows;
+    size_t kernel_columns;
+    size_t offset_y;
+    std::vector<Row> window;
+    std::vector<const Row*> window_rows;
+    std::vector<uint32_t> columns;
+    uint32_t next_row = 0;
+};
+
+// One of the eight symmetries of the rectangle: quarter_turns clockwise rotations followed by an
+// optional horizontal mirror.
+struct DihedralTransform {
+    int quarter_turns = 0;
+    bool mirrored = false;
+
+    // A mirror followed by a rotation equals the opposite rotation followed by the mirror.
+    void rotate90() { quarter_turns = (quarter_turns + (mirrored ? 3 : 1)) % 4; }
+
+    // A vertical mirror is a half turn followed by a horizontal mirror.
+    void mirror(bool horizontal) {
+        if (!horizontal) {
+            quarter_turns = (quarter_turns + 2) % 4;
+        }
+        mirrored = !mirrored;
+    }
+};
+
+// Borders are clamped on both axes, so a kernel with odd sides followed by a rotation or mirror
+// equals the same rotation or mirror followed by the kernel transformed like the image. The anchor
+// of an even side is off center and would move, so such kernels are never transformed.
+Kernel rotateKernel90(const Kernel& kernel) {
+    size_t rows = kernel.size();
+    size_t columns = kernel[0].size();
+    Kernel rotated(columns, std::vector<int>(rows));
+    for (size_t y = 0; y < columns; ++y) {
+        for (size_t x = 0; x < rows; ++x) {
+            rotated[y][x] = kernel[rows - 1 - x][y];
+        }
+    }
+    return rotated;
+}
+
+Kernel mirrorKernel(Kernel kernel, bool horizontal) {
+    if (horizontal) {
+        for (std::vector<int>& row : kernel) {
+            std::reverse(row.begin(), row.end());
+        }
+    } else {
+        std::reverse(kernel.begin(), kernel.end());
+    }
+    return kernel;
+}
+
+ImagePlane<ColorRGB> materialize(RowStream& stream) {
+    ImagePlane<ColorRGB> rows(stream.width, stream.height);
+    for (uint32_t y = 0; y < stream.height; ++y) {
+        stream.produce(y, rows[y]);
+    }
+    return rows;
+}
+
+}  // namespace
+
+Pipeline& Pipeline::rotate(int angle, ColorRGB fill_color, bool smart_gap_interpolation) {
+    angle = angle % 360;
+    if (angle < 0) angle += 360;
+
+    if (angle % 90 != 0) {
+        handleLogMessage("Вращение на произвольный угол не поддерживается. Пожалуйста, используйте кратные 90 градусов.", Severity::WARNING);
+        return *this;
+    }
+    for (int i = 0; i < angle / 90; ++i) {
+        operations.push_back({.type = OperationType::ROTATE_90});
+    }
+    return *this;
+}
+
+Pipeline& Pipeline::mirror(bool horizontal) {
+    operations.push_back({.type = OperationType::MIRROR, .horizontal = horizontal});
+    return *this;
+}
+
+Pipeline& Pipeline::applyKernel(const std::vector<std::vector<int>>& kernel, int divisor) {
+    bool rectangular = !kernel.empty() && !kernel[0].empty()
+        && std::all_of(kernel.begin(), kernel.end(), [&](const auto& row) { return row.size() == kernel[0].size(); });
+    if (!rectangular) {
+        handleLogMessage("Некорректный размер ядра. Строки ядра должны быть непустыми и одинаковой длины.", Severity::ERROR, 1);
+        return *this;
+    }
+    operations.push_back({OperationType::KERNEL, false, kernel, divisor});
+    return *this;
+}
+
+Pipeline& Pipeline::sharpen() {
+    return applyKernel({
+        { 0, -1,  0},
+        {-1,  5, -1},
+        { 0, -1,  0}
+    });
+}
+
+Pipeline& Pipeline::gaussianBlurApprox(bool hard_blur) {
+    if (!hard_blur) {
+        return applyKernel({
+            {1, 2, 1},
+            {2, 4, 2},
+            {1, 2, 1}
+        }, 16);
+    }
+    return applyKernel({
+        {1, 1, 1},
+        {1, 1, 1},
+        {1, 1, 1}
+    }, 9);
+}
+
+Pipeline& Pipeline::edgeDetect() {
+    return applyKernel({
+        {-1, -1, -1},
+        {-1,  8, -1},
+        {-1, -1, -1}
+    });
+}
+
+Pipeline& Pipeline::negative() {
+    operations.push_back({.type = OperationType::NEGATIVE});
+    return *this;
+}
+
+Pipeline& Pipeline::grayscale() {
+    operations.push_back({.type = OperationType::GRAYSCALE});
+    return *this;
+}
+
+size_t Pipeline::size() const {
+    return operations.size();
+}
+
+bool Pipeline::empty() const {
+    return operations.empty();
+}
+
+size_t Pipeline::splitPoint(size_t begin) const {
+    auto geometric = [](const Operation& operation) {
+        return operation.type == OperationType::ROTATE_90 || operation.type == OperationType::MIRROR;
+    };
+    for (size_t i = begin; i < operations.size(); ++i) {
+        const Operation& operation = operations[i];
+        bool even_kernel = operation.type == OperationType::KERNEL
+            && (operation.kernel.size() % 2 == 0 || operation.kernel[0].size() % 2 == 0);
+        if (even_kernel && std::any_of(operations.begin() + i + 1, operations.end(), geometric)) {
+            return i + 1;
+        }
+    }
+    return operations.size();
+}
+
+Pipeline Pipeline::simplified() const {
+    if (splitPoint(0) < operations.size()) {
+        return *this;
+    }
+    DihedralTransform transform;
+    // Non-geometric operations, rewritten to act after the geometric ones seen so far.
+    std::vector<Operation> stages;
+    for (const Operation& operation : operations) {
+        switch (operation.type) {
+            case OperationType::ROTATE_90:
+                transform.rotate90();
+                for (Operation& stage : stages) {
+                    if (stage.type == OperationType::KERNEL) {
+                        stage.kernel = rotateKernel90(stage.kernel);
+                    }
+                }
+                break;
+            case OperationType::MIRROR:
+                transform.mirror(operation.horizontal);
+                for (Operation& stage : stages) {
+                    if (stage.type == OperationType::KERNEL) {
+                        stage.kernel = mirrorKernel(std::move(stage.kernel), operation.horizontal);
+                    }
+                }
+                break;
+            case OperationType::NEGATIVE:
+                if (!stages.empty() && stages.back().type == OperationType::NEGATIVE) {
+                    stages.pop_back();
+                } else {
+                    stages.push_back(operation);
+                }
+                break;
+            case OperationType::GRAYSCALE:
+                if (stages.empty() || stages.back().type != OperationType::GRAYSCALE) {
+                    stages.push_back(operation);
+                }
+                break;
+            case OperationType::KERNEL:
+                stages.push_back(operation);
+                break;
+        }
+    }
+
+    Pipeline result;
+    for (int i = 0; i < transform.quarter_turns; ++i) {
+        result.operations.push_back({.type = OperationType::ROTATE_90});
+    }
+    if (transform.mirrored) {
+        result.operations.push_back({.type = OperationType::MIRROR, .horizontal = true});
+    }
+    result.operations.insert(result.operations.end(), stages.begin(), stages.end());
+    return result;
+}
+
+void Pipeline::run(UncompressedImage& img) const {
+    for (size_t begin = 0; begin < operations.size();) {
+        size_t end = splitPoint(begin);
+        Pipeline part;
+        part.operations.assign(operations.begin() + begin, operations.begin() + end);
+        part.simplified().execute(img);
+        begin = end;
+    }
+}
+
+void Pipeline::execute(UncompressedImage& img) const {
+    uint64_t pixel_count = static_cast<uint64_t>(img.getWidth()) * img.getHeight();
+    STAGE_TIMER(timer, "pipeline", pixel_count, pixel_count * (img.hasGrayStorage() ? 1 : 3));
+    if (operations.empty() || pixel_count == 0) {
+        return;
+    }
+
+    bool gray_storage = img.hasGrayStorage();
+    bool is_grayscale = img.getIsGrayscale();
+    const ImagePlane<ColorRGB>* color_rows = gray_storage ? nullptr : &img.getImageData();
+    const ImagePlane<uint8_t>* gray_rows = gray_storage ? &img.getGrayData() : nullptr;
+    CoordinateMap map(img.getWidth(), img.getHeight());
+    std::unique_ptr<RowStream> stream;
+    PointStream* last_point_stream = nullptr;
+
+    // simplified() puts all rotations and mirrors first, so they only compose the source remap.
+    for (const Operation& operation : operations) {
+        if (operation.type == OperationType::ROTATE_90) {
+            map.rotate90();
+            continue;
+        }
+        if (operation.type == OperationType::MIRROR) {
+            map.mirror(operation.horizontal);
+            continue;
+        }
+
+        if (operation.type == OperationType::GRAYSCALE) {
+            if (is_grayscale) {
+                continue;
+            }
+            is_grayscale = true;
+        }
+        if (!stream) {
+            stream = std::make_unique<SourceStream>(color_rows, gray_rows, map);
+        }
+
+        if (operation.type == OperationType::KERNEL) {
+            stream = std::make_unique<KernelStream>(std::move(stream), operation.kernel, operation.divisor);
+            last_point_stream = nullptr;
+            continue;
+        }
+        if (last_point_stream == nullptr) {
+            auto point_stream = std::make_unique<PointStream>(std::move(stream));
+            last_point_stream = point_stream.get();
+            stream = std::move(point_stream);
+        }
+        last_point_stream->add(operation.type == OperationType::NEGATIVE ? PointOperation::NEGATIVE
+                                                                           : PointOperation::GRAYSCALE);
+    }
+
+    if (!stream) {
+        stream = std::make_unique<SourceStream>(color_rows, gray_rows, map);
+    }
+    ImagePlane<ColorRGB> result = materialize(*stream);
+    stream.reset();
+
+    img.setWidth(result.rowLength());
+    img.setHeight(result.size());
+    if (gray_storage) {
+        ImagePlane<uint8_t> gray(result.rowLength(), result.size());
+        std::transform(result.data(), result.data() + result.pixelCount(), gray.data(),
+                       [](const ColorRGB& color) { return color.r; });
+        img.setGrayData(std::move(gray));
+    } else {
+        img.setImageData(std::move(result));
+    }
+    if (is_grayscale) {
+        img.setIsGrayscale(true);
+    }
+    LOG_INFO("Конвейер из ", operations.size(), " операций выполнен.");
+}
+
+LazyImage::LazyImage(UncompressedImage img) : image(std::move(img)) {}
+
+LazyImage& LazyImage::rotate(int angle, ColorRGB fill_color, bool smart_gap_interpolation) {
+    if (angle % 90 != 0) {
+        evaluate();
+        ::rotate(image, angle, fill_color, smart_gap_interpolation);
+        return *this;
+    }
+    pending.rotate(angle);
+    return *this;
+}
+
+LazyImage& LazyImage::mirror(bool horizontal) {
+    pending.mirror(horizontal);
+    return *this;
+}
+
+LazyImage& LazyImage::applyKernel(const std::vector<std::vector<int>>& kernel, int divisor) {
+    pending.applyKernel(kernel, divisor);
+    return *this;
+}
+
+LazyImage& LazyImage::sharpen() {
+    pending.sharpen();
+    return *this;
+}
+
+LazyImage& LazyImage::gaussianBlurApprox(bool hard_blur) {
+    pending.gaussianBlurApprox(hard_blur);
+    return *this;
+}
+
+LazyImage& LazyImage::edgeDetect() {
+    pending.edgeDetect();
+    return *this;
+}
+
+LazyImage& LazyImage::negative() {
+    pending.negative();
+    return *this;
+}
+
+LazyImage& LazyImage::grayscale() {
+    pending.grayscale();
+    return *this;
+}
+
+size_t LazyImage::pendingOperations() const {
+    return pending.size();
+}
+
+const UncompressedImage& LazyImage::evaluate() {
+    if (!pending.empty()) {
+        pending.run(image);
+        pending = Pipeline();
+    }
+    return image;
+}
@@ -0,0 +1,207 @@
+#include "synthetic_images.h"
+#include "error_handlers.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <unordered_set>
+
+static constexpr uint32_t FLAT_REGION_COUNT = 24;
+
+static uint64_t splitMix64(uint64_t value) {
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+class SplitMixRandom {
+public:
+    explicit SplitMixRandom(uint64_t seed) : state(seed) {}
+
+    uint64_t next() { return splitMix64(state++); }
+    double uniform() { return (next() >> 11) * 0x1.0p-53; }
+
+private:
+    uint64_t state;
+};
+
+static uint8_t toChannel(double value) {
+    return static_cast<uint8_t>(std::clamp(value, 0.0, 1.0) * 255 + 0.5);
+}
+
+// Colors along a smooth loop through the RGB cube, jittered until all of them are distinct.
+static std::vector<ColorRGB> makePalette(uint32_t color_count, bool grayscale, uint64_t seed) {
+    std::vector<ColorRGB> palette;
+    palette.reserve(color_count);
+    if (grayscale) {
+        for (uint32_t i = 0; i < color_count; ++i) {
+            uint8_t gray = color_count == 1 ? 128 : i * 255 / (color_count - 1);
+            palette.push_back(ColorRGB{gray, gray, gray});
+        }
+        return palette;
+    }
+
+    SplitMixRandom random(seed);
+    std::unordered_set<ColorRGB, ColorHash> used;
+    for (uint32_t i = 0; i < color_count; ++i) {
+        double t = color_count == 1 ? 0.5 : static_cast<double>(i) / (color_count - 1);
+        ColorRGB color{toChannel(t), toChannel(0.5 + 0.5 * std::sin(6.283185307 * t)),
+                       toChannel(1 - t)};
+        while (!used.insert(color).second) {
+            color = ColorRGB{static_cast<uint8_t>(color.r + random.next() % 5 - 2),
+                             static_cast<uint8_t>(color.g + random.next() % 5 - 2),
+                             static_cast<uint8_t>(color.b + random.next() % 5 - 2)};
+        }
+        palette.push_back(color);
+    }
+    return palette;
+}
+
+SyntheticImageGenerator::SyntheticImageGenerator(const SyntheticImageOptions& options)
+    : options(options) {
+    if (options.width == 0 || options.height == 0) {
+        throw std::invalid_argument("Synthetic image must not be empty");
+    }
+    if (options.color_count > MAX_PALETTE_SIZE
+        || (options.grayscale && options.color_count > 256)) {
+        throw std::invalid_argument("Too many colors for a synthetic image palette");
+    }
+    if (options.color_count > 0) {
+        palette = makePalette(options.color_count, options.grayscale, options.seed);
+    }
+
+    SplitMixRandom random(splitMix64(options.seed ^ 0xF1A7));
+    double image_area = static_cast<double>(options.width) * options.height;
+    double region_area = std::clamp(options.flat_fraction, 0.0, 1.0) * image_area / FLAT_REGION_COUNT;
+    if (region_area < 1) {
+        return;
+    }
+    for (uint32_t i = 0; i < FLAT_REGION_COUNT; ++i) {
+        double aspect = 0.5 + 1.5 * random.uniform();
+        auto region_width = static_cast<uint32_t>(
+            std::clamp(std::sqrt(region_area * aspect), 1.0, static_cast<double>(options.width)));
+        auto region_height = static_cast<uint32_t>(std::clamp(
+            region_area / region_width, 1.0, static_cast<double>(options.height)));
+        FlatRegion region;
+        region.x0 = random.next() % (options.width - region_width + 1);
+        region.y0 = random.next() % (options.height - region_height + 1);
+        region.x1 = region.x0 + region_width;
+        region.y1 = region.y0 + region_height;
+        region.index = palette.empty() ? 0 : random.next() % palette.size();
+        uint64_t bits = random.next();
+        uint8_t gray = bits;
+        region.color = !palette.empty() ? palette[region.index]
+                       : options.grayscale
+                           ? ColorRGB{gray, gray, gray}
+                           : ColorRGB{static_cast<uint8_t>(bits), static_cast<uint8_t>(bits >> 8),
+                                      static_cast<uint8_t>(bits >> 16)};
+        flat_regions.push_back(region);
+    }
+}
+
+const SyntheticImageOptions& SyntheticImageGenerator::getOptions() const { return options; }
+
+bool SyntheticImageGenerator::hasPalette() const { return !palette.empty(); }
+
+const std::vector<ColorRGB>& SyntheticImageGenerator::getPalette() const { return palette; }
+
+// Channel 0 follows x, channel 1 follows y and channel 2 the diagonal; grayscale images and
+// palette indices use the diagonal.
+double SyntheticImageGenerator::channelValue(
+    uint32_t x, uint32_t y, int channel, uint64_t hash) const {
+    double fx = options.width > 1 ? static_cast<double>(x) / (options.width - 1) : 0.5;
+    double fy = options.height > 1 ? static_cast<double>(y) / (options.height - 1) : 0.5;
+    double position = channel == 0 ? fx : channel == 1 ? fy : (fx + fy) / 2;
+    double noise = ((hash >> (channel * 21)) & 0x1FFFFF) * (2.0 / 0x1FFFFF) - 1;
+    return 0.5 + options.gradient * (position - 0.5) + options.noise * noise;
+}
+
+void SyntheticImageGenerator::generateIndexRow(uint32_t y, std::vector<uint32_t>& row) const {
+    row.resize(options.width);
+    uint64_t row_seed = splitMix64(options.seed ^ (static_cast<uint64_t>(y) << 32));
+    double palette_size = palette.size();
+    for (uint32_t x = 0; x < options.width; ++x) {
+        double value = std::clamp(channelValue(x, y, 2, splitMix64(row_seed + x)), 0.0, 1.0);
+        row[x] = std::min<uint32_t>(value * palette_size, palette.size() - 1);
+    }
+    for (const FlatRegion& region : flat_regions) {
+        if (y >= region.y0 && y < region.y1) {
+            std::fill(row.begin() + region.x0, row.begin() + region.x1, region.index);
+        }
+    }
+}
+
+void SyntheticImageGenerator::generateRow(uint32_t y, std::vector<ColorRGB>& row) const {
+    row.resize(options.width);
+    if (hasPalette()) {
+        std::vector<uint32_t> indices;
+        generateIndexRow(y, indices);
+        for (uint32_t x = 0; x < options.width; ++x) {
+            row[x] = palette[indices[x]];
+        }
+        return;
+    }
+
+    uint64_t row_seed = splitMix64(options.seed ^ (static_cast<uint64_t>(y) << 32));
+    for (uint32_t x = 0; x < options.width; ++x) {
+        uint64_t hash = splitMix64(row_seed + x);
+        if (options.grayscale) {
+            uint8_t gray = toChannel(channelValue(x, y, 2, hash));
+            row[x] = ColorRGB{gray, gray, gray};
+        } else {
+            row[x] = ColorRGB{toChannel(channelValue(x, y, 0, hash)),
+                              toChannel(channelValue(x, y, 1, hash)),
+                              toChannel(channelValue(x, y, 2, hash))};
+        }
+    }
+    for (const FlatRegion& region : flat_regions) {
+        if (y >= region.y0 && y < region.y1) {
+            std::fill(row.begin() + region.x0, row.begin() + region.x1, region.color);
+        }
+    }
+}
+
+UncompressedImage SyntheticImageGenerator::generate() const {
+    ImagePlane<ColorRGB> rows(options.width, options.height);
+    std::vector<ColorRGB> row;
+    for (uint32_t y = 0; y < options.height; ++y) {
+        generateRow(y, row);
+        std::copy(row.begin(), row.end(), rows[y].begin());
+    }
+    UncompressedImage img;
+    img.setWidth(options.width);
+    img.setHeight(options.height);
+    img.setIsGrayscale(options.grayscale);
+    img.setImageData(std::move(rows));
+    return img;
+}
+
+CompressedImage SyntheticImageGenerator::generateCompressed() const {
+    if (!hasPalette() || palette.size() > 256) {
+        handleLogMessage(
+            "Для CompressedImage нужна палитра не более чем из 256 цветов.", Severity::ERROR);
+        return CompressedImage();
+    }
+
+    std::map<uint8_t, ColorRGB> id_to_color;
+    std::unordered_map<ColorRGB, uint8_t, ColorHash> color_to_id;
+    for (size_t i = 0; i < palette.size(); ++i) {
+        id_to_color[i] = palette[i];
+        color_to_id[palette[i]] = i;
+    }
+
+    ImagePlane<uint8_t> rows(options.width, options.height);
+    std::vector<uint32_t> indices;
+    for (uint32_t y = 0; y < options.height; ++y) {
+        generateIndexRow(y, indices);
+        std::copy(indices.begin(), indices.end(), rows[y].begin());
+    }
+
+    CompressedImage img;
+    img.setWidth(options.width);
+    img.setHeight(options.height);
+    img.setIdToColor(std::move(id_to_color));
+    img.setColorToId(std::move(color_to_id));
+    img.setImageData(std::move(rows));
+    return img;
+}
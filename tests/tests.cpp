@@ -1,14 +1,29 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <thread>
+#include <unordered_set>
 
 #include "compressor_funcs.h"
+#include "image_row_writer.h"
 #include "image_transforms.h"
 #include "images.h"
 #include "libbmp.h"
 #include "colors.h"
 #include "error_handlers.h"
+#include "async_writer.h"
+#include "batch_loader.h"
+#include "buffer_pool.h"
+#include "metrics.h"
+#include "palette_lut.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "synthetic_images.h"
 
 std::vector<uint8_t> loadFile(const std::string& filename) {
     std::ifstream file(filename, std::ios::binary);
@@ -26,6 +41,11 @@ bool matchVectors(const std::vector<T>& v1, const std::vector<T>& v2) {
     return v1 == v2;
 }
 
+template<typename T>
+bool matchVectors(const ImagePlane<T>& v1, const ImagePlane<T>& v2) {
+    return v1 == v2;
+}
+
 struct TestAwarder {
   public:
     TestAwarder(const std::string& filename = "", bool verbose = true) : verbose_(verbose) {
@@ -801,3 +821,1141 @@ TEST_CASE("Conversion to compressed image and back (without color add, with appr
     closeLogFile();
     awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
 }
+
+TEST_CASE("Compressed image pyramid levels") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_27.log", true);
+
+    UncompressedImage img = loadFromBMP("images/red_cross.bmp");
+    CompressedImage comp_img = toCompressed(img);
+
+    writeCompressedFile("tmp_images/red_cross_pyramid.img", comp_img, 8);
+
+    CompressedImage level_0 = readLevel("tmp_images/red_cross_pyramid.img", 0);
+    REQUIRE(level_0.width == comp_img.width);
+    REQUIRE(level_0.height == comp_img.height);
+    REQUIRE(matchUncompressedImages(img, toUncompressed(level_0), false));
+
+    const std::vector<uint32_t> level_sizes = {4, 2, 1};
+    for (size_t level = 1; level <= level_sizes.size(); ++level) {
+        CompressedImage level_img = readLevel("tmp_images/red_cross_pyramid.img", level);
+        REQUIRE(level_img.width == level_sizes[level - 1]);
+        REQUIRE(level_img.height == level_sizes[level - 1]);
+    }
+
+    CompressedImage level_1 = readLevel("tmp_images/red_cross_pyramid.img", 1);
+    for (size_t i = 0; i < level_1.height; ++i) {
+        for (size_t j = 0; j < level_1.width; ++j) {
+            if (i == j || i == level_1.height - j - 1) {
+                REQUIRE(getColor(level_1, j, i) == ColorRGB{255, 0, 0});
+            } else {
+                REQUIRE(getColor(level_1, j, i) == ColorRGB{0, 0, 0});
+            }
+        }
+    }
+
+    CompressedImage missing_level = readLevel("tmp_images/red_cross_pyramid.img", 4);
+    REQUIRE(missing_level.width == 0);
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Uncompressed image delta coding") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_28.log", true);
+
+    UncompressedImage img = loadFromBMP("images/kapibara.bmp");
+    writeUncompressedFile("tmp_images/kapibara_raw_v1.img", img);
+    writeUncompressedFile("tmp_images/kapibara_raw_v2.img", img, true);
+
+    UncompressedImage img_copy = readUncompressedFile("tmp_images/kapibara_raw_v2.img");
+    REQUIRE(matchUncompressedImages(img, img_copy, false));
+    REQUIRE(
+        loadFile("tmp_images/kapibara_raw_v2.img").size()
+        < loadFile("tmp_images/kapibara_raw_v1.img").size());
+
+    toGrayscale(img);
+    writeUncompressedFile("tmp_images/kapibara_gray_raw_v2.img", img, true);
+    UncompressedImage gray_copy = readUncompressedFile("tmp_images/kapibara_gray_raw_v2.img");
+    REQUIRE(matchUncompressedImages(img, gray_copy, false));
+
+    // Noisy images of sizes around the row groups that the decoder reconstructs together.
+    for (auto [width, height] : std::vector<std::pair<uint32_t, uint32_t>>{{1, 1}, {6, 3}, {3, 6}, {97, 42}}) {
+        SyntheticImageOptions options;
+        options.width = width;
+        options.height = height;
+        options.noise = 0.5;
+        UncompressedImage noisy = SyntheticImageGenerator(options).generate();
+        REQUIRE(noisy.writeToFile("tmp_images/noisy_raw_v2.img", true));
+        UncompressedImage noisy_copy;
+        REQUIRE(noisy_copy.readFromFile("tmp_images/noisy_raw_v2.img"));
+        REQUIRE(matchUncompressedImages(noisy, noisy_copy, false));
+    }
+
+    // Writes that fail after the file is opened, here for lack of space, are reported.
+    REQUIRE_FALSE(img.writeToFile("/dev/full"));
+    REQUIRE_FALSE(img.writeToFile("/dev/full", true));
+    REQUIRE_FALSE(toCompressed(img).writeToFile("/dev/full"));
+
+    // A payload size past the end of the file is rejected before the payload is allocated.
+    std::vector<uint8_t> corrupted = loadFile("tmp_images/kapibara_gray_raw_v2.img");
+    constexpr size_t PAYLOAD_SIZE_OFFSET = 10 + 3 + 4 + 4 + 1 + 1;
+    std::fill_n(corrupted.begin() + PAYLOAD_SIZE_OFFSET, 8, 0xFF);
+    std::ofstream("tmp_images/kapibara_corrupted_v2.img", std::ios::binary)
+        .write(reinterpret_cast<const char*>(corrupted.data()), corrupted.size());
+    UncompressedImage corrupted_img;
+    REQUIRE_FALSE(corrupted_img.readFromFile("tmp_images/kapibara_corrupted_v2.img"));
+
+    // So are a width and height that the payload or the pixel data cannot hold.
+    constexpr size_t HEIGHT_OFFSET = 10 + 3 + 4;
+    for (const char* source : {"tmp_images/kapibara_gray_raw_v2.img", "tmp_images/kapibara_raw_v1.img"}) {
+        corrupted = loadFile(source);
+        std::fill_n(corrupted.begin() + HEIGHT_OFFSET, 4, 0x7F);
+        std::ofstream("tmp_images/kapibara_corrupted_v2.img", std::ios::binary)
+            .write(reinterpret_cast<const char*>(corrupted.data()), corrupted.size());
+        REQUIRE_FALSE(corrupted_img.readFromFile("tmp_images/kapibara_corrupted_v2.img"));
+        REQUIRE_FALSE(corrupted_img.readFromFile("tmp_images/kapibara_corrupted_v2.img", true));
+    }
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Grayscale native storage") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_29.log", true);
+
+    UncompressedImage img = loadFromBMP("images/kapibara.bmp");
+    toGrayscale(img);
+    UncompressedImage compact_img = img;
+    compact_img.compactGrayscale();
+
+    REQUIRE(compact_img.hasGrayStorage());
+    REQUIRE(compact_img.getImageData().empty());
+    REQUIRE(matchUncompressedImages(img, compact_img, false));
+
+    rotate(img, 90);
+    rotate(compact_img, 90);
+    mirror(img, true);
+    mirror(compact_img, true);
+    negative(img);
+    negative(compact_img);
+    sharpen(img);
+    sharpen(compact_img);
+    REQUIRE(compact_img.hasGrayStorage());
+    REQUIRE(matchUncompressedImages(img, compact_img, false));
+
+    writeUncompressedFile("tmp_images/kapibara_gray_compact.img", compact_img);
+    writeUncompressedFile("tmp_images/kapibara_gray_expanded.img", img);
+    REQUIRE(matchVectors(
+        loadFile("tmp_images/kapibara_gray_compact.img"),
+        loadFile("tmp_images/kapibara_gray_expanded.img")));
+
+    UncompressedImage loaded_img = readUncompressedFile("tmp_images/kapibara_gray_compact.img", true);
+    REQUIRE(loaded_img.hasGrayStorage());
+    REQUIRE(matchUncompressedImages(img, loaded_img, false));
+
+    loaded_img.expandGrayscale();
+    REQUIRE_FALSE(loaded_img.hasGrayStorage());
+    REQUIRE(matchVectors(img.getImageData(), loaded_img.getImageData()));
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Asynchronous image writer") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_30.log", true);
+
+    UncompressedImage img = loadFromBMP("images/kapibara.bmp");
+    CompressedImage comp_img = toCompressed(loadFromBMP("images/red_cross.bmp"));
+    saveAsBMP(img, "tmp_images/kapibara_sync.bmp");
+    writeUncompressedFile("tmp_images/kapibara_sync.img", img);
+    writeCompressedFile("tmp_images/red_cross_sync.img", comp_img);
+
+    {
+        AsyncImageWriter writer(2);
+        std::future<void> bmp_written = writer.saveAsBMP(img, "tmp_images/kapibara_async.bmp");
+        std::future<void> raw_written =
+            writer.writeUncompressedFile(img, "tmp_images/kapibara_async.img");
+        writer.writeCompressedFile(comp_img, "tmp_images/red_cross_async.img");
+        bmp_written.get();
+        raw_written.get();
+        writer.flush();
+    }
+
+    REQUIRE(matchVectors(
+        loadFile("tmp_images/kapibara_async.bmp"), loadFile("tmp_images/kapibara_sync.bmp")));
+    REQUIRE(matchVectors(
+        loadFile("tmp_images/kapibara_async.img"), loadFile("tmp_images/kapibara_sync.img")));
+    REQUIRE(matchVectors(
+        loadFile("tmp_images/red_cross_async.img"), loadFile("tmp_images/red_cross_sync.img")));
+
+    {
+        AsyncImageWriter writer(2);
+        std::future<void> bmp_failed = writer.saveAsBMP(img, "tmp_images/missing/kapibara.bmp");
+        std::future<void> raw_failed =
+            writer.writeUncompressedFile(img, "tmp_images/missing/kapibara.img");
+        std::future<void> compressed_failed =
+            writer.writeCompressedFile(comp_img, "tmp_images/missing/red_cross.img");
+        REQUIRE_THROWS_AS(bmp_failed.get(), std::runtime_error);
+        REQUIRE_THROWS_AS(raw_failed.get(), std::runtime_error);
+        REQUIRE_THROWS_AS(compressed_failed.get(), std::runtime_error);
+    }
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Batch BMP loading") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_31.log", true);
+
+    std::vector<std::string> filenames = {
+        "images/kapibara.bmp", "images/red_cross.bmp", "images/missing.bmp", "images/kapibara.bmp"};
+    BatchLoadResult result = loadBMPBatch(filenames, 4);
+
+    REQUIRE(result.images.size() == filenames.size());
+    REQUIRE(result.failed_files == 1);
+    REQUIRE(!result.loaded[2]);
+    REQUIRE(result.files_per_second > 0);
+    for (size_t i : {0, 1, 3}) {
+        REQUIRE(result.loaded[i]);
+        REQUIRE(matchUncompressedImages(result.images[i], loadFromBMP(filenames[i]), false));
+    }
+
+    // Headers of a 2x2 24-bit image followed by its pixels; corrupted fields must be rejected
+    // before anything is allocated or read out of bounds.
+    std::vector<uint8_t> bmp(sizeof(BMPHeader) + sizeof(BMPInfoHeader) + 16, 0);
+    auto writeHeaders = [&](int32_t width, int32_t height, uint32_t offset_data) {
+        BMPHeader file_header;
+        BMPInfoHeader info_header;
+        file_header.offset_data = offset_data;
+        info_header.width = width;
+        info_header.height = height;
+        info_header.bit_count = 24;
+        std::memcpy(bmp.data(), &file_header, sizeof(file_header));
+        std::memcpy(bmp.data() + sizeof(file_header), &info_header, sizeof(info_header));
+    };
+    uint32_t pixels_offset = sizeof(BMPHeader) + sizeof(BMPInfoHeader);
+    UncompressedImage decoded;
+    writeHeaders(2, -2, pixels_offset);
+    REQUIRE(decodeBMPBuffer(bmp, decoded));
+    REQUIRE(decoded.getHeight() == 2);
+    writeHeaders(2, INT32_MIN, pixels_offset);
+    REQUIRE(!decodeBMPBuffer(bmp, decoded));
+    writeHeaders(2, 3, pixels_offset);
+    REQUIRE(!decodeBMPBuffer(bmp, decoded));
+    writeHeaders(INT32_MAX, INT32_MAX, pixels_offset);
+    REQUIRE(!decodeBMPBuffer(bmp, decoded));
+    writeHeaders(2, 2, UINT32_MAX);
+    REQUIRE(!decodeBMPBuffer(bmp, decoded));
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Asynchronous logging") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    constexpr size_t THREADS = 4;
+    constexpr size_t MESSAGES_PER_THREAD = 1000;
+
+    // Logs from several threads through the async ring and returns the lines that reached the
+    // file and the lines the ring dropped.
+    auto logFromThreads = [](const std::string& log_path, size_t capacity, LogOverflowPolicy policy) {
+        openLogFile(log_path, true);
+        enableAsyncLogging(capacity, policy);
+
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < THREADS; ++t) {
+            threads.emplace_back([t] {
+                for (size_t i = 0; i < MESSAGES_PER_THREAD; ++i) {
+                    handleLogMessage(
+                        "Поток " + std::to_string(t) + ", сообщение " + std::to_string(i),
+                        Severity::INFO);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        size_t dropped = droppedLogMessages();
+        closeLogFile();
+        disableAsyncLogging();
+
+        std::ifstream log(log_path);
+        size_t lines = 0;
+        for (std::string line; std::getline(log, line);) {
+            REQUIRE(line.rfind("[INFO]: Поток ", 0) == 0);
+            ++lines;
+        }
+        return std::pair{lines, dropped};
+    };
+
+    auto [blocked_lines, blocked_dropped] = logFromThreads("logs/test_32.log", 64, LogOverflowPolicy::BLOCK);
+    REQUIRE(blocked_lines == THREADS * MESSAGES_PER_THREAD);
+    REQUIRE(blocked_dropped == 0);
+
+    auto [kept_lines, dropped_lines] = logFromThreads("logs/test_50.log", 4, LogOverflowPolicy::DROP);
+    REQUIRE(dropped_lines > 0);
+    REQUIRE(kept_lines + dropped_lines == THREADS * MESSAGES_PER_THREAD);
+
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Per-thread log contexts") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    constexpr size_t MESSAGES_PER_THREAD = 1000;
+    openLogFile("logs/test_33.log", true);
+
+    std::vector<std::thread> threads;
+    for (const std::string image_name : {"kapibara.bmp", "red_cross.bmp"}) {
+        threads.emplace_back([image_name] {
+            ScopedLogContext context({"job-" + image_name, image_name});
+            for (size_t i = 0; i < MESSAGES_PER_THREAD; ++i) {
+                handleLogMessage("Сообщение " + std::to_string(i), Severity::INFO);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    handleLogMessage("Без контекста", Severity::INFO);
+
+    closeLogFile();
+
+    std::ifstream log("logs/test_33.log");
+    std::map<std::string, size_t> lines_per_prefix;
+    for (std::string line; std::getline(log, line);) {
+        ++lines_per_prefix[line.substr(0, line.find(": "))];
+    }
+    REQUIRE(lines_per_prefix.size() == 3);
+    REQUIRE(lines_per_prefix["[INFO] [job=job-kapibara.bmp] [image=kapibara.bmp]"]
+            == MESSAGES_PER_THREAD);
+    REQUIRE(lines_per_prefix["[INFO] [job=job-red_cross.bmp] [image=red_cross.bmp]"]
+            == MESSAGES_PER_THREAD);
+    REQUIRE(lines_per_prefix["[INFO]"] == 1);
+
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Lazy log message formatting") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    size_t formatted_arguments = 0;
+    auto counted = [&formatted_arguments](int value) {
+        ++formatted_arguments;
+        return value;
+    };
+
+    openLogFile("logs/test_34.log", false);
+    LOG_INFO("Вращение изображения выполнено на ", counted(90), " градусов.");
+    closeLogFile();
+    REQUIRE(formatted_arguments == 0);
+
+    openLogFile("logs/test_34.log", true);
+    LOG_INFO("Вращение изображения выполнено на ", counted(90), " градусов.");
+    LOG_WARNING("Размер: ", 3u, 'x', 2.5f);
+    closeLogFile();
+
+    std::ifstream log("logs/test_34.log");
+    std::string info_line;
+    std::string warning_line;
+    std::getline(log, info_line);
+    std::getline(log, warning_line);
+    if constexpr (COMPILED_MIN_SEVERITY <= Severity::INFO) {
+        REQUIRE(formatted_arguments == 1);
+        REQUIRE(info_line == "[INFO]: Вращение изображения выполнено на 90 градусов.");
+        REQUIRE(warning_line == "[WARNING]: Размер: 3x2.500000");
+    } else {
+        REQUIRE(formatted_arguments == 0);
+    }
+
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Stage timing metrics") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_35.log", true);
+    MetricsRegistry::instance().reset();
+
+    UncompressedImage img = loadFromBMP("images/kapibara.bmp");
+    uint64_t pixels = static_cast<uint64_t>(img.getWidth()) * img.getHeight();
+    rotate(img, 90);
+    rotate(img, 270);
+    sharpen(img);
+
+    std::map<std::string, StageStats> stats;
+    for (const StageStats& stage : MetricsRegistry::instance().snapshot()) {
+        stats[stage.name] = stage;
+    }
+    REQUIRE(stats["loadFromBMP"].count == 1);
+    REQUIRE(stats["rotate"].count == 2);
+    REQUIRE(stats["rotate"].pixels == 2 * pixels);
+    REQUIRE(stats["rotate"].bytes == 6 * pixels);
+    REQUIRE(stats["rotate"].p50_seconds > 0);
+    REQUIRE(stats["rotate"].p50_seconds <= stats["rotate"].p99_seconds);
+    REQUIRE(stats["sharpen"].count == 1);
+    REQUIRE(stats["applyKernel"].count == 1);
+
+    REQUIRE(MetricsRegistry::instance().exportToFile("logs/test_35.json", MetricsFormat::JSON));
+    REQUIRE(MetricsRegistry::instance().exportToFile("logs/test_35.prom", MetricsFormat::PROMETHEUS));
+    std::vector<uint8_t> prometheus_file = loadFile("logs/test_35.prom");
+    std::string prometheus(prometheus_file.begin(), prometheus_file.end());
+    REQUIRE(prometheus.find("image_compressor_stage_seconds_count{stage=\"rotate\"} 2")
+            != std::string::npos);
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Synthetic image generator") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_36.log", true);
+
+    SyntheticImageOptions options;
+    options.width = 301;
+    options.height = 199;
+    options.color_count = 37;
+    options.noise = 0.1;
+    options.flat_fraction = 0.3;
+    options.seed = 7;
+    SyntheticImageGenerator generator(options);
+    UncompressedImage img = generator.generate();
+
+    REQUIRE(img.getWidth() == options.width);
+    REQUIRE(img.getHeight() == options.height);
+    REQUIRE(matchUncompressedImages(img, SyntheticImageGenerator(options).generate(), false));
+
+    std::unordered_set<ColorRGB, ColorHash> colors;
+    for (const auto& row : img.getImageData()) {
+        colors.insert(row.begin(), row.end());
+    }
+    REQUIRE(colors.size() <= options.color_count);
+    REQUIRE(colors.size() > 1);
+
+    REQUIRE(matchUncompressedImages(toUncompressed(generator.generateCompressed()), img, false));
+
+    // Streaming the rows gives the same files the in-memory image reads back from.
+    ImageRowWriter writer;
+    std::vector<ColorRGB> row;
+    REQUIRE(writer.openRaw("tmp_images/synthetic.img", options.width, options.height, false));
+    for (uint32_t y = 0; y < options.height; ++y) {
+        generator.generateRow(y, row);
+        REQUIRE(writer.writeRow(std::span<const ColorRGB>(row)));
+    }
+    REQUIRE(writer.finish());
+    REQUIRE(matchUncompressedImages(readUncompressedFile("tmp_images/synthetic.img"), img, false));
+
+    REQUIRE(writer.openBMP("tmp_images/synthetic.bmp", options.width, options.height));
+    for (uint32_t y = 0; y < options.height; ++y) {
+        generator.generateRow(y, row);
+        REQUIRE(writer.writeRow(std::span<const ColorRGB>(row)));
+    }
+    REQUIRE(writer.finish());
+    REQUIRE(matchUncompressedImages(loadFromBMP("tmp_images/synthetic.bmp"), img, false));
+
+    std::vector<uint32_t> indices;
+    std::vector<uint8_t> ids;
+    REQUIRE(writer.openCompressed(
+        "tmp_images/synthetic.cmpr", options.width, options.height, generator.getPalette()));
+    REQUIRE(!writer.writeRow(std::span<const ColorRGB>(row)));
+    REQUIRE(writer.openCompressed(
+        "tmp_images/synthetic.cmpr", options.width, options.height, generator.getPalette()));
+    for (uint32_t y = 0; y < options.height; ++y) {
+        generator.generateIndexRow(y, indices);
+        ids.assign(indices.begin(), indices.end());
+        REQUIRE(writer.writeRow(std::span<const uint8_t>(ids)));
+    }
+    REQUIRE(!writer.writeRow(std::span<const uint8_t>(ids)));
+    REQUIRE(!writer.finish());
+    REQUIRE(writer.openCompressed(
+        "tmp_images/synthetic.cmpr", options.width, options.height, generator.getPalette()));
+    for (uint32_t y = 0; y < options.height; ++y) {
+        generator.generateIndexRow(y, indices);
+        ids.assign(indices.begin(), indices.end());
+        REQUIRE(writer.writeRow(std::span<const uint8_t>(ids)));
+    }
+    REQUIRE(writer.finish());
+    REQUIRE(matchUncompressedImages(
+        toUncompressed(readCompressedFile("tmp_images/synthetic.cmpr")), img, false));
+    REQUIRE(!writer.openBMP("tmp_images/synthetic.bmp", 40000, 40000));
+
+    options.seed = 8;
+    REQUIRE(!matchUncompressedImages(img, SyntheticImageGenerator(options).generate(), false));
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Fused transform pipeline") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_37.log", true);
+
+    UncompressedImage img = loadFromBMP("images/kapibara.bmp");
+
+    UncompressedImage sequential = img;
+    rotate(sequential, 90);
+    sharpen(sequential);
+    toGrayscale(sequential);
+    UncompressedImage fused = img;
+    Pipeline().rotate(90).sharpen().grayscale().run(fused);
+    REQUIRE(fused.getWidth() == img.getHeight());
+    REQUIRE(fused.getHeight() == img.getWidth());
+    REQUIRE(matchUncompressedImages(fused, sequential, false));
+
+    sequential = img;
+    negative(sequential);
+    mirror(sequential, true);
+    gaussianBlurApprox(sequential);
+    edgeDetect(sequential);
+    rotate(sequential, 270);
+    mirror(sequential);
+    fused = img;
+    Pipeline().negative().mirror(true).gaussianBlurApprox().edgeDetect().rotate(270).mirror().run(fused);
+    REQUIRE(matchUncompressedImages(fused, sequential, false));
+
+    fused = img;
+    Pipeline().rotate(45).run(fused);
+    REQUIRE(matchUncompressedImages(fused, img, false));
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Lazy image with simplified transforms") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_38.log", true);
+
+    UncompressedImage img = loadFromBMP("images/kapibara.bmp");
+
+    REQUIRE(Pipeline().rotate(90).rotate(270).negative().negative().simplified().empty());
+    REQUIRE(Pipeline().mirror(true).mirror().simplified().size() == 2);
+    REQUIRE(Pipeline().rotate(90).mirror().rotate(90).negative().mirror(true).simplified().size() == 3);
+
+    LazyImage lazy(img);
+    lazy.mirror(true).rotate(90).negative().sharpen().rotate(180).negative().negative().mirror();
+    REQUIRE(lazy.pendingOperations() == 9);
+
+    UncompressedImage sequential = img;
+    mirror(sequential, true);
+    rotate(sequential, 90);
+    negative(sequential);
+    sharpen(sequential);
+    rotate(sequential, 180);
+    mirror(sequential);
+    REQUIRE(matchUncompressedImages(lazy.evaluate(), sequential, false));
+    REQUIRE(lazy.pendingOperations() == 0);
+
+    std::vector<std::vector<int>> asymmetric = {{1, 2, 0}, {0, 3, -1}, {4, 0, 0}};
+    applyKernel(sequential, asymmetric, 9);
+    rotate(sequential, 270);
+    rotate(sequential, 30);
+    lazy.applyKernel(asymmetric, 9).rotate(270).rotate(30);
+    REQUIRE(lazy.pendingOperations() == 0);
+    REQUIRE(matchUncompressedImages(lazy.evaluate(), sequential, false));
+
+    // Rectangular kernels turn with the image; kernels with an even side stay where they are.
+    SyntheticImageOptions options;
+    options.width = 61;
+    options.height = 37;
+    options.noise = 0.4;
+    UncompressedImage noisy = SyntheticImageGenerator(options).generate();
+    std::vector<std::vector<int>> motion_blur(1, std::vector<int>(15, 1));
+    std::vector<std::vector<int>> tall = {{1, 0, 2, 0, 1}, {0, -1, 3, 1, 0}, {2, 1, 0, 0, -2}};
+    std::vector<std::vector<int>> even = {{1, 2, 0}, {3, -1, 1}};
+    REQUIRE(Pipeline().applyKernel(even).rotate(90).simplified().size() == 2);
+
+    sequential = noisy;
+    applyKernel(sequential, motion_blur, 15);
+    rotate(sequential, 90);
+    applyKernel(sequential, even, 6);
+    mirror(sequential, true);
+    applyKernel(sequential, tall, 6);
+    rotate(sequential, 180);
+    negative(sequential);
+    applyKernel(sequential, even, 6);
+    mirror(sequential);
+    LazyImage rectangular(noisy);
+    rectangular.applyKernel(motion_blur, 15).rotate(90).applyKernel(even, 6).mirror(true)
+        .applyKernel(tall, 6).rotate(180).negative().applyKernel(even, 6).mirror();
+    REQUIRE(matchUncompressedImages(rectangular.evaluate(), sequential, false));
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Point operations on the palette") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_39.log", true);
+
+    SyntheticImageOptions options;
+    options.width = 120;
+    options.height = 80;
+    options.color_count = 64;
+    options.noise = 0.2;
+    CompressedImage img = SyntheticImageGenerator(options).generateCompressed();
+    UncompressedImage expected = toUncompressed(img);
+
+    auto swap_channels = [](const ColorRGB& color) { return ColorRGB{color.b, color.r, color.g}; };
+    applyPointOp(img, swap_channels);
+    ImagePlane<ColorRGB> rows = expected.getImageData();
+    for (ColorRGB& color : rows.pixels()) {
+        color = swap_channels(color);
+    }
+    expected.setImageData(rows);
+    REQUIRE(matchUncompressedImages(toUncompressed(img), expected, false));
+    REQUIRE(mergeDuplicateColors(img) == 0);
+
+    auto posterize = [](const ColorRGB& color) {
+        return ColorRGB{static_cast<uint8_t>(color.r & 0x80), static_cast<uint8_t>(color.g & 0x80),
+                        static_cast<uint8_t>(color.b & 0x80)};
+    };
+    applyPointOp(img, posterize);
+    for (ColorRGB& color : rows.pixels()) {
+        color = posterize(color);
+    }
+    expected.setImageData(rows);
+    REQUIRE(img.getIdToColor().size() == options.color_count);
+    REQUIRE(img.getColorToId().size() <= 8);
+    REQUIRE(matchUncompressedImages(toUncompressed(img), expected, false));
+
+    REQUIRE(mergeDuplicateColors(img) == options.color_count - img.getColorToId().size());
+    REQUIRE(img.getIdToColor().size() == img.getColorToId().size());
+    REQUIRE(matchUncompressedImages(toUncompressed(img), expected, false));
+    REQUIRE(img.getIdToColor().rbegin()->first == img.getIdToColor().size() - 1);
+
+    writeCompressedFile("tmp_images/posterized.img", img);
+    REQUIRE(matchUncompressedImages(
+        toUncompressed(readCompressedFile("tmp_images/posterized.img")), expected, false));
+    CompressedImage loaded;
+    REQUIRE(img.writeToFile("tmp_images/posterized_member.img"));
+    REQUIRE(loaded.readFromFile("tmp_images/posterized_member.img"));
+    REQUIRE(matchUncompressedImages(toUncompressed(loaded), expected, false));
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Rotation of CompressedImage index planes") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_40.log", true);
+
+    SyntheticImageOptions options;
+    options.width = 97;
+    options.height = 61;
+    options.color_count = 40;
+    options.noise = 0.2;
+    CompressedImage img = SyntheticImageGenerator(options).generateCompressed();
+
+    for (int angle : {90, 180, 270, -90}) {
+        CompressedImage rotated = img;
+        rotate(rotated, angle);
+        UncompressedImage expected = toUncompressed(img);
+        rotate(expected, angle);
+        REQUIRE(matchUncompressedImages(toUncompressed(rotated), expected, false));
+        REQUIRE(rotated.getIdToColor().size() == options.color_count);
+    }
+
+    ColorRGB fill_color{1, 2, 3};
+    CompressedImage rotated = img;
+    rotate(rotated, 30, fill_color);
+    REQUIRE(rotated.getWidth() == 115);
+    REQUIRE(rotated.getHeight() == 101);
+    REQUIRE(rotated.getIdToColor().size() == options.color_count + 1);
+    REQUIRE(getColor(rotated, 0, 0) == fill_color);
+    REQUIRE(getColor(rotated, rotated.getWidth() / 2, rotated.getHeight() / 2)
+            == getColor(img, img.getWidth() / 2, img.getHeight() / 2));
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("In-place mirroring") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_41.log", true);
+
+    SyntheticImageOptions options;
+    options.width = 157;
+    options.height = 43;
+    options.color_count = 200;
+    options.noise = 0.3;
+    SyntheticImageGenerator generator(options);
+
+    for (bool horizontal : {true, false}) {
+        UncompressedImage img = generator.generate();
+        ImagePlane<ColorRGB> expected(img.getWidth(), img.getHeight());
+        for (uint32_t y = 0; y < img.getHeight(); ++y) {
+            std::span<const ColorRGB> row = img.getImageData()[horizontal ? y : img.getHeight() - 1 - y];
+            std::copy(row.begin(), row.end(), expected[y].begin());
+            if (horizontal) {
+                std::reverse(expected[y].begin(), expected[y].end());
+            }
+        }
+        const ColorRGB* pixels = img.getImageData().data();
+        mirror(img, horizontal);
+        REQUIRE(img.getImageData() == expected);
+        REQUIRE(img.getImageData().data() == pixels);
+
+        SyntheticImageOptions gray_options = options;
+        gray_options.color_count = 0;
+        gray_options.grayscale = true;
+        UncompressedImage gray = SyntheticImageGenerator(gray_options).generate();
+        gray.compactGrayscale();
+        ImagePlane<uint8_t> expected_gray(gray.getWidth(), gray.getHeight());
+        for (uint32_t y = 0; y < gray.getHeight(); ++y) {
+            std::span<const uint8_t> row = gray.getGrayData()[horizontal ? y : gray.getHeight() - 1 - y];
+            std::copy(row.begin(), row.end(), expected_gray[y].begin());
+            if (horizontal) {
+                std::reverse(expected_gray[y].begin(), expected_gray[y].end());
+            }
+        }
+        mirror(gray, horizontal);
+        REQUIRE(gray.getGrayData() == expected_gray);
+
+        CompressedImage compressed = generator.generateCompressed();
+        UncompressedImage expected_compressed = toUncompressed(compressed);
+        mirror(compressed, horizontal);
+        mirror(expected_compressed, horizontal);
+        REQUIRE(matchUncompressedImages(toUncompressed(compressed), expected_compressed, false));
+    }
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Moving pixel data in and out of images") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_42.log", true);
+
+    ImagePlane<ColorRGB> rows(4, 3, ColorRGB{1, 2, 3});
+    const ColorRGB* buffer = rows.data();
+    UncompressedImage img(4, 3);
+    img.setImageData(std::move(rows));
+    REQUIRE(img.getImageData()[0].data() == buffer);
+
+    img.getMutableRow(1)[2] = ColorRGB{9, 9, 9};
+    REQUIRE(img.getMutableRow(1).size() == 4);
+    REQUIRE(img.getPixel(2, 1) == ColorRGB{9, 9, 9});
+
+    ImagePlane<ColorRGB> taken = img.takeImageData();
+    REQUIRE(taken.data() == buffer);
+    REQUIRE(img.getImageData().empty());
+
+    CompressedImage compressed(4, 3);
+    std::map<uint8_t, ColorRGB> id_to_color = {{0, ColorRGB{1, 2, 3}}, {1, ColorRGB{9, 9, 9}}};
+    std::unordered_map<ColorRGB, uint8_t, ColorHash> color_to_id = {{ColorRGB{1, 2, 3}, 0}, {ColorRGB{9, 9, 9}, 1}};
+    compressed.setIdToColor(std::move(id_to_color));
+    compressed.setColorToId(std::move(color_to_id));
+    compressed.getMutableRow(1)[2] = 1;
+    ImagePlane<uint8_t> ids = compressed.takeImageData();
+    const uint8_t* id_buffer = ids.data();
+    compressed.setImageData(std::move(ids));
+    REQUIRE(compressed.getImageData()[0].data() == id_buffer);
+
+    img.setImageData(std::move(taken));
+    REQUIRE(matchUncompressedImages(toUncompressed(compressed), img, false));
+    REQUIRE(matchUncompressedImages(toUncompressed(toCompressed(img)), img, false));
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Pooled buffer allocator") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_43.log", true);
+
+    BufferPool& pool = BufferPool::instance();
+    REQUIRE(BufferPool::blockSize(1) == BufferPool::MIN_BLOCK_SIZE);
+    REQUIRE(BufferPool::blockSize(BufferPool::MIN_BLOCK_SIZE + 1) == 2 * BufferPool::MIN_BLOCK_SIZE);
+
+    void* block = pool.allocate(5 << 20);
+    REQUIRE(reinterpret_cast<uintptr_t>(block) % BufferPool::HUGE_PAGE_SIZE == 0);
+    pool.deallocate(block, 5 << 20);
+    BufferPoolStats before = pool.stats();
+    void* same_class_block = pool.allocate(6 << 20);
+    REQUIRE(same_class_block == block);
+    REQUIRE(pool.stats().reused == before.reused + 1);
+    REQUIRE(pool.stats().system_allocations == before.system_allocations);
+    pool.deallocate(same_class_block, 6 << 20);
+
+    // Catch assertions are not thread-safe, so workers only count mismatches.
+    std::atomic<int> mismatches{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&mismatches] {
+            for (int i = 0; i < 1000; ++i) {
+                PooledVector<uint8_t> buffer(100000 + i, static_cast<uint8_t>(i));
+                if (buffer.back() != static_cast<uint8_t>(i)) {
+                    ++mismatches;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(mismatches == 0);
+    REQUIRE(pool.stats().system_allocations - before.system_allocations <= 8);
+
+    std::vector<std::string> files(8, "images/kapibara.bmp");
+    BatchLoadResult first = loadBMPBatch(files, 8, 2);
+    BatchLoadResult second = loadBMPBatch(files, 8, 2);
+    REQUIRE(second.failed_files == 0);
+    REQUIRE(matchUncompressedImages(second.images[7], first.images[0], false));
+
+    // Planes are pool blocks: a 3 MiB plane is huge-page aligned, and the plane every rotation
+    // replaces is the block the next rotation writes into.
+    UncompressedImage large(1024, 1024);
+    REQUIRE(reinterpret_cast<uintptr_t>(large.getImageData().data()) % BufferPool::HUGE_PAGE_SIZE == 0);
+    rotate(large, 90);
+    before = pool.stats();
+    for (int i = 0; i < 4; ++i) {
+        rotate(large, 90);
+    }
+    REQUIRE(pool.stats().system_allocations == before.system_allocations);
+    REQUIRE(pool.stats().reused >= before.reused + 4);
+
+    pool.trim();
+    REQUIRE(pool.stats().cached_bytes == 0);
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Banded parallel transforms") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_44.log", true);
+
+    std::vector<int> hits(1000, 0);
+    parallelForBands(hits.size(), 16, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            ++hits[i];
+        }
+    }, 7);
+    REQUIRE(std::all_of(hits.begin(), hits.end(), [](int h) { return h == 1; }));
+
+    UncompressedImage img(613, 421);
+    for (uint32_t y = 0; y < img.getHeight(); ++y) {
+        auto row = img.getMutableRow(y);
+        for (uint32_t x = 0; x < img.getWidth(); ++x) {
+            row[x] = ColorRGB{static_cast<uint8_t>(x * 7 + y), static_cast<uint8_t>(x ^ y), static_cast<uint8_t>(y * 3)};
+        }
+    }
+    UncompressedImage serial = img;
+    UncompressedImage banded = img;
+    setDefaultWorkerThreads(1);
+    sharpen(serial);
+    rotate(serial, 90);
+    setDefaultWorkerThreads(4);
+    sharpen(banded);
+    rotate(banded, 90);
+    setDefaultWorkerThreads(0);
+    REQUIRE(banded.getWidth() == 421);
+    REQUIRE(matchUncompressedImages(banded, serial, false));
+
+    BufferPool& pool = BufferPool::instance();
+    pool.setHugePageMode(HugePageMode::EXPLICIT);
+    void* block = pool.allocate(4 << 20);
+    REQUIRE(reinterpret_cast<uintptr_t>(block) % BufferPool::HUGE_PAGE_SIZE == 0);
+    pool.deallocate(block, 4 << 20);
+    pool.setHugePageMode(HugePageMode::TRANSPARENT);
+    pool.trim();
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Fixed-point grayscale conversion") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_45.log", true);
+
+    std::vector<ColorRGB> colors(1 << 24);
+    for (uint32_t c = 0; c < colors.size(); ++c) {
+        colors[c] = ColorRGB{static_cast<uint8_t>(c >> 16), static_cast<uint8_t>(c >> 8), static_cast<uint8_t>(c)};
+    }
+    std::vector<uint8_t> gray(colors.size());
+    toGrayscaleRow(colors.data(), gray.data(), colors.size());
+    size_t mismatches = 0;
+    for (uint32_t c = 0; c < colors.size(); ++c) {
+        double luma = 0.299 * colors[c].r + 0.587 * colors[c].g + 0.114 * colors[c].b;
+        uint8_t expected = static_cast<uint8_t>(std::round(luma));
+        mismatches += colorToGrayscale(colors[c]) != expected || gray[c] != expected;
+    }
+    REQUIRE(mismatches == 0);
+
+    std::vector<uint8_t> tail(37);
+    toGrayscaleRow(colors.data() + 12345, tail.data(), tail.size());
+    REQUIRE(std::equal(tail.begin(), tail.end(), gray.begin() + 12345));
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Nearest-palette lookup table") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_46.log", true);
+
+    std::map<uint8_t, ColorRGB> palette = {
+        {9, {0, 0, 0}}, {3, {255, 255, 255}}, {7, {200, 16, 16}}, {1, {16, 200, 16}},
+        {5, {16, 16, 200}}, {2, {128, 128, 128}}, {8, {128, 128, 128}}, {4, {64, 64, 64}}};
+    std::shared_ptr<const PaletteLUT> lut = PaletteLUT::build(palette);
+    size_t mismatches = 0;
+    for (uint32_t c = 0; c < PaletteLUT::ENTRY_COUNT; c += 101) {
+        ColorRGB color{static_cast<uint8_t>(c >> 16), static_cast<uint8_t>(c >> 8), static_cast<uint8_t>(c)};
+        mismatches += lut->lookup(color) != findClosestColorId(color, palette);
+    }
+    REQUIRE(mismatches == 0);
+    REQUIRE(lut->lookup(ColorRGB{128, 128, 128}) == 2);
+
+    REQUIRE(lut->save("logs/test_46.lut"));
+    std::shared_ptr<const PaletteLUT> loaded = PaletteLUT::load("logs/test_46.lut");
+    REQUIRE(loaded != nullptr);
+    REQUIRE(loaded->getPalette() == palette);
+    REQUIRE(loaded->lookup(ColorRGB{190, 30, 20}) == lut->lookup(ColorRGB{190, 30, 20}));
+
+    PaletteLUT::clearShared();
+    REQUIRE(PaletteLUT::acquire(palette, 1) == nullptr);
+    std::shared_ptr<const PaletteLUT> shared = PaletteLUT::acquire(palette, PaletteLUT::BUILD_THRESHOLD_PIXELS);
+    REQUIRE(shared != nullptr);
+    REQUIRE(PaletteLUT::acquire(palette, 1) == shared);
+
+    SyntheticImageOptions options;
+    options.width = 97;
+    options.height = 53;
+    options.noise = 0.2;
+    UncompressedImage img = SyntheticImageGenerator(options).generate();
+    CompressedImage approximate = toCompressed(img, palette, true);
+    CompressedImage searched = toCompressed(img, palette, false);
+    REQUIRE(approximate.getImageData() == searched.getImageData());
+    PaletteLUT::clearShared();
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Per-channel lookup tables") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_47.log", true);
+
+    ChannelLUT gamma = gammaLUT(2.2);
+    ChannelLUT levels = levelsLUT(20, 230);
+    ChannelLUT contrast = contrastLUT(1.5);
+    REQUIRE(gamma[0] == 0);
+    REQUIRE(gamma[255] == 255);
+    REQUIRE(gamma[128] > 128);
+    REQUIRE(levels[20] == 0);
+    REQUIRE(levels[125] == 128);
+    REQUIRE(levels[240] == 255);
+    REQUIRE(contrast[10] == 0);
+    REQUIRE(contrast[245] == 255);
+
+    SyntheticImageOptions options;
+    options.width = 211;
+    options.height = 7;
+    options.noise = 0.5;
+    options.color_count = 64;
+    UncompressedImage img = SyntheticImageGenerator(options).generate();
+    UncompressedImage expected = img;
+    for (uint32_t y = 0; y < expected.getHeight(); ++y) {
+        for (ColorRGB& color : expected.getMutableRow(y)) {
+            color = ColorRGB{gamma[color.r], levels[color.g], contrast[color.b]};
+        }
+    }
+    applyChannelLUT(img, gamma, levels, contrast);
+    REQUIRE(matchUncompressedImages(img, expected, false));
+
+    UncompressedImage inverted = img;
+    negative(inverted);
+    negative(inverted);
+    REQUIRE(matchUncompressedImages(inverted, img, false));
+
+    // Large enough to be split into bands; negative() takes the arithmetic path, not the table.
+    options.width = 517;
+    options.height = 300;
+    UncompressedImage banded = SyntheticImageGenerator(options).generate();
+    UncompressedImage banded_expected = banded;
+    for (uint32_t y = 0; y < banded_expected.getHeight(); ++y) {
+        for (ColorRGB& color : banded_expected.getMutableRow(y)) {
+            color = ColorRGB{gamma[color.r], levels[color.g], contrast[color.b]};
+        }
+    }
+    UncompressedImage banded_negative = banded;
+    applyChannelLUT(banded, gamma, levels, contrast);
+    REQUIRE(matchUncompressedImages(banded, banded_expected, false));
+    UncompressedImage banded_lut = banded_negative;
+    negative(banded_negative);
+    applyChannelLUT(banded_lut, negativeLUT());
+    REQUIRE(matchUncompressedImages(banded_negative, banded_lut, false));
+    options.width = 211;
+    options.height = 7;
+
+    options.grayscale = true;
+    UncompressedImage gray = SyntheticImageGenerator(options).generate();
+    gray.compactGrayscale();
+    uint8_t first = gray.getGrayData()[0][0];
+    applyChannelLUT(gray, gamma);
+    REQUIRE(gray.hasGrayStorage());
+    REQUIRE(gray.getGrayData()[0][0] == gamma[first]);
+
+    CompressedImage compressed = toCompressed(expected);
+    applyChannelLUT(compressed, negativeLUT());
+    negative(expected);
+    REQUIRE(matchUncompressedImages(toUncompressed(compressed), expected, false));
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Rectangular kernels and FFT convolution") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_48.log", true);
+
+    SyntheticImageOptions options;
+    options.width = 150;
+    options.height = 90;
+    options.noise = 0.3;
+    UncompressedImage img = SyntheticImageGenerator(options).generate();
+    options.grayscale = true;
+    UncompressedImage gray = SyntheticImageGenerator(options).generate();
+    gray.compactGrayscale();
+
+    // Straightforward correlation of every channel, the reference for both the direct and FFT paths.
+    auto directKernel = [](const UncompressedImage& source, const std::vector<std::vector<int>>& kernel, int divisor) {
+        int kernel_rows = kernel.size();
+        int kernel_columns = kernel[0].size();
+        UncompressedImage result(source.getWidth(), source.getHeight(), source.getIsGrayscale());
+        for (uint32_t y = 0; y < source.getHeight(); ++y) {
+            for (uint32_t x = 0; x < source.getWidth(); ++x) {
+                int sum[3] = {0, 0, 0};
+                for (int ky = 0; ky < kernel_rows; ++ky) {
+                    for (int kx = 0; kx < kernel_columns; ++kx) {
+                        int iy = std::clamp<int>(y + ky - kernel_rows / 2, 0, source.getHeight() - 1);
+                        int ix = std::clamp<int>(x + kx - kernel_columns / 2, 0, source.getWidth() - 1);
+                        ColorRGB color = source.getPixel(ix, iy);
+                        sum[0] += color.r * kernel[ky][kx];
+                        sum[1] += color.g * kernel[ky][kx];
+                        sum[2] += color.b * kernel[ky][kx];
+                    }
+                }
+                result.setPixel(x, y, ColorRGB{
+                    static_cast<uint8_t>(std::clamp(sum[0] / divisor, 0, 255)),
+                    static_cast<uint8_t>(std::clamp(sum[1] / divisor, 0, 255)),
+                    static_cast<uint8_t>(std::clamp(sum[2] / divisor, 0, 255))});
+            }
+        }
+        return result;
+    };
+
+    std::vector<std::vector<int>> motion_blur(1, std::vector<int>(15, 1));
+    std::vector<std::vector<int>> even = {{1, 2}, {3, -1}};
+    std::vector<std::vector<int>> large(13, std::vector<int>(9));
+    for (size_t ky = 0; ky < large.size(); ++ky) {
+        for (size_t kx = 0; kx < large[ky].size(); ++kx) {
+            large[ky][kx] = static_cast<int>((ky * 7 + kx * 3) % 5) - 1;
+        }
+    }
+
+    for (const auto& [kernel, divisor] : std::vector<std::pair<std::vector<std::vector<int>>, int>>{
+             {motion_blur, 15}, {even, 5}, {large, 40}}) {
+        UncompressedImage filtered = img;
+        applyKernel(filtered, kernel, divisor);
+        REQUIRE(matchUncompressedImages(filtered, directKernel(img, kernel, divisor), false));
+
+        UncompressedImage gray_filtered = gray;
+        applyKernel(gray_filtered, kernel, divisor);
+        REQUIRE(gray_filtered.hasGrayStorage());
+        REQUIRE(matchUncompressedImages(gray_filtered, directKernel(gray, kernel, divisor), false));
+    }
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
+
+TEST_CASE("Box and Gaussian blur of any radius") {
+    constexpr size_t TEST_AWARD_POINTS = 1;
+    openLogFile("logs/test_49.log", true);
+
+    SyntheticImageOptions options;
+    options.width = 123;
+    options.height = 77;
+    options.noise = 0.4;
+    UncompressedImage img = SyntheticImageGenerator(options).generate();
+
+    for (int radius : {1, 4, MAX_BOX_BLUR_RADIUS}) {
+        int side = 2 * radius + 1;
+        UncompressedImage expected = img;
+        applyKernel(expected, std::vector<std::vector<int>>(side, std::vector<int>(side, 1)), side * side);
+        UncompressedImage blurred = img;
+        boxBlur(blurred, radius);
+        REQUIRE(matchUncompressedImages(blurred, expected, false));
+    }
+
+    UncompressedImage hard = img;
+    gaussianBlurApprox(hard, true);
+    UncompressedImage box = img;
+    applyKernel(box, {{1, 1, 1}, {1, 1, 1}, {1, 1, 1}}, 9);
+    REQUIRE(matchUncompressedImages(hard, box, false));
+
+    // Box mean rounded to nearest with replicated borders, one pass of the Gaussian approximation.
+    auto roundedBoxBlur = [](const UncompressedImage& source, int radius) {
+        int area = (2 * radius + 1) * (2 * radius + 1);
+        UncompressedImage result(source.getWidth(), source.getHeight());
+        for (uint32_t y = 0; y < source.getHeight(); ++y) {
+            for (uint32_t x = 0; x < source.getWidth(); ++x) {
+                int sum[3] = {0, 0, 0};
+                for (int dy = -radius; dy <= radius; ++dy) {
+                    for (int dx = -radius; dx <= radius; ++dx) {
+                        int iy = std::clamp<int>(y + dy, 0, source.getHeight() - 1);
+                        int ix = std::clamp<int>(x + dx, 0, source.getWidth() - 1);
+                        ColorRGB color = source.getPixel(ix, iy);
+                        sum[0] += color.r;
+                        sum[1] += color.g;
+                        sum[2] += color.b;
+                    }
+                }
+                result.setPixel(x, y, ColorRGB{
+                    static_cast<uint8_t>((sum[0] + area / 2) / area),
+                    static_cast<uint8_t>((sum[1] + area / 2) / area),
+                    static_cast<uint8_t>((sum[2] + area / 2) / area)});
+            }
+        }
+        return result;
+    };
+
+    // Sigma 3 takes boxes of width 5, 5 and 7; sigma 6.5 three boxes of width 13.
+    for (const auto& [sigma, radii] : std::vector<std::pair<double, std::vector<int>>>{
+             {3, {2, 2, 3}}, {6.5, {6, 6, 6}}}) {
+        UncompressedImage expected = img;
+        for (int radius : radii) {
+            expected = roundedBoxBlur(expected, radius);
+        }
+        UncompressedImage blurred = img;
+        gaussianBlur(blurred, sigma);
+        REQUIRE(matchUncompressedImages(blurred, expected, false));
+    }
+
+    UncompressedImage flat(64, 48);
+    for (uint32_t y = 0; y < flat.getHeight(); ++y) {
+        std::span<ColorRGB> row = flat.getMutableRow(y);
+        std::fill(row.begin(), row.end(), ColorRGB{200, 17, 99});
+    }
+    UncompressedImage flat_blurred = flat;
+    gaussianBlur(flat_blurred, 6.5);
+    REQUIRE(matchUncompressedImages(flat_blurred, flat, false));
+    gaussianBlur(flat_blurred, MAX_GAUSSIAN_SIGMA);
+    REQUIRE(matchUncompressedImages(flat_blurred, flat, false));
+    // Boxes wider than MAX_BOX_BLUR_RADIUS allows are refused rather than overflowing the sums.
+    gaussianBlur(flat_blurred, 2500);
+    REQUIRE(matchUncompressedImages(flat_blurred, flat, false));
+
+    options.grayscale = true;
+    UncompressedImage gray = SyntheticImageGenerator(options).generate();
+    gray.compactGrayscale();
+    gaussianBlur(gray, 3);
+    REQUIRE(gray.hasGrayStorage());
+
+    closeLogFile();
+    awarder.awardPoints(TEST_AWARD_POINTS, Catch::getResultCapture().getCurrentTestName());
+}
@@ -0,0 +1,142 @@
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "image_row_writer.h"
+#include "synthetic_images.h"
+
+/*
+ * Writes a deterministic synthetic image without keeping it in memory, so sizes up to 32K x 32K
+ * work on ordinary machines.
+ *
+ * Usage: generate_image --out=FILE [--format=bmp|raw|cmpr] [--width=N] [--height=N]
+ *                       [--colors=N] [--noise=0..1] [--gradient=0..1] [--flat=0..1]
+ *                       [--grayscale] [--seed=N]
+ *
+ * The format defaults to the extension of the output file (.bmp, .img/.raw, .cmpr). CMPRIMAGE
+ * needs --colors between 1 and 256. BMP files are limited to 4 GiB, which 24-bit pixels reach
+ * only beyond 32K x 32K; RAWIMAGE and CMPRIMAGE have no such limit.
+ */
+
+static constexpr uint32_t MAX_DIMENSION = 32768;
+
+static bool writeImage(
+    const SyntheticImageGenerator& generator, const std::string& format, const std::string& output) {
+    const SyntheticImageOptions& options = generator.getOptions();
+    ImageRowWriter writer;
+    if (format == "cmpr") {
+        size_t color_count = generator.getPalette().size();
+        if (color_count == 0 || color_count > 256) {
+            std::cerr << "CMPRIMAGE needs --colors between 1 and 256" << std::endl;
+            return false;
+        }
+        if (!writer.openCompressed(output, options.width, options.height, generator.getPalette())) {
+            return false;
+        }
+        std::vector<uint32_t> indices;
+        std::vector<uint8_t> ids;
+        for (uint32_t y = 0; y < options.height; ++y) {
+            generator.generateIndexRow(y, indices);
+            ids.assign(indices.begin(), indices.end());
+            if (!writer.writeRow(std::span<const uint8_t>(ids))) {
+                return false;
+            }
+        }
+        return writer.finish();
+    }
+
+    bool opened = format == "bmp" ? writer.openBMP(output, options.width, options.height)
+                                  : writer.openRaw(output, options.width, options.height,
+                                                   options.grayscale);
+    if (!opened) {
+        return false;
+    }
+    std::vector<ColorRGB> row;
+    for (uint32_t y = 0; y < options.height; ++y) {
+        generator.generateRow(y, row);
+        if (!writer.writeRow(std::span<const ColorRGB>(row))) {
+            return false;
+        }
+    }
+    return writer.finish();
+}
+
+static std::string defaultFormat(const std::string& filename) {
+    std::string extension = filename.substr(filename.find_last_of('.') + 1);
+    if (extension == "img") {
+        return "raw";
+    }
+    return extension;
+}
+
+int main(int argc, char** argv) {
+    SyntheticImageOptions options;
+    std::string output;
+    std::string format;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            std::string value = arg.substr(arg.find('=') + 1);
+            if (arg.rfind("--out=", 0) == 0) {
+                output = value;
+            } else if (arg.rfind("--format=", 0) == 0) {
+                format = value;
+            } else if (arg.rfind("--width=", 0) == 0) {
+                options.width = std::stoul(value);
+            } else if (arg.rfind("--height=", 0) == 0) {
+                options.height = std::stoul(value);
+            } else if (arg.rfind("--colors=", 0) == 0) {
+                options.color_count = std::stoul(value);
+            } else if (arg.rfind("--noise=", 0) == 0) {
+                options.noise = std::stod(value);
+            } else if (arg.rfind("--gradient=", 0) == 0) {
+                options.gradient = std::stod(value);
+            } else if (arg.rfind("--flat=", 0) == 0) {
+                options.flat_fraction = std::stod(value);
+            } else if (arg.rfind("--seed=", 0) == 0) {
+                options.seed = std::stoull(value);
+            } else if (arg == "--grayscale") {
+                options.grayscale = true;
+            } else {
+                std::cerr << "Unknown argument: " << arg << std::endl;
+                return 2;
+            }
+        }
+    } catch (const std::exception&) {
+        std::cerr << "Invalid argument value" << std::endl;
+        return 2;
+    }
+
+    if (output.empty()) {
+        std::cerr << "Usage: " << argv[0] << " --out=FILE [--format=bmp|raw|cmpr] [--width=N] "
+                  << "[--height=N] [--colors=N] [--noise=0..1] [--gradient=0..1] [--flat=0..1] "
+                  << "[--grayscale] [--seed=N]\n"
+                  << "BMP files must stay under 4 GiB (a 24-bit 32K x 32K image takes 3 GiB); "
+                  << "CMPRIMAGE needs --colors between 1 and 256." << std::endl;
+        return 2;
+    }
+    if (options.width > MAX_DIMENSION || options.height > MAX_DIMENSION) {
+        std::cerr << "Width and height must not exceed " << MAX_DIMENSION << std::endl;
+        return 2;
+    }
+    if (format.empty()) {
+        format = defaultFormat(output);
+    }
+    if (format != "bmp" && format != "raw" && format != "cmpr") {
+        std::cerr << "Unknown format: " << format << std::endl;
+        return 2;
+    }
+
+    try {
+        SyntheticImageGenerator generator(options);
+        if (!writeImage(generator, format, output)) {
+            std::cerr << "Cannot write " << output << std::endl;
+            return 1;
+        }
+        return 0;
+    } catch (const std::invalid_argument& error) {
+        std::cerr << error.what() << std::endl;
+        return 2;
+    }
+}